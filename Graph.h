@@ -1,4 +1,5 @@
 #import <Foundation/Foundation.h>
+#import <stdint.h>
 
 
 //***************************************************************************
@@ -19,6 +20,55 @@
 
 
 
+//***************************************************************************
+
+/*
+  cgraph_t : a compact (integer-indexed) view of the structure of a
+  Digraph, for the queries of the inference hot path
+
+  ** nodes are the dense ids 0..nodes-1 (the values of the nodes of
+     the Digraph, which must be the numbers 0..nodes-1 in any order)
+  ** in[in_ptr[i]..in_ptr[i+1]) are the predecessors of node i and
+     out[out_ptr[i]..out_ptr[i+1]) are its successors (both sorted)
+  ** the edges are numbered in target-major order : edge k is
+     (in[k], trg[k]), so the edges of target i are k = in_ptr[i]..
+
+  Degrees are O(1), edge queries are O(log degree) and iteration
+  allocates nothing.
+ */
+
+typedef struct cgraph {
+
+    int nodes; // number of nodes
+    int edges; // number of edges
+    int *in_ptr; // nodes+1 offsets into in
+    int *in; // predecessors (the source of each edge)
+    int *trg; // the target of each edge
+    int *out_ptr; // nodes+1 offsets into out
+    int *out; // successors
+
+} cgraph_t;
+
+
+#define CGRAPH_IN_DEGREE(g, i) ((g)->in_ptr[(i)+1] - (g)->in_ptr[(i)])
+#define CGRAPH_OUT_DEGREE(g, i) ((g)->out_ptr[(i)+1] - (g)->out_ptr[(i)])
+
+
+// build a compact graph from nedges (from[k], to[k]) pairs
+// (without duplicates)
+cgraph_t *cgraph_alloc(int nodes, int nedges, const int *from, const int *to);
+void cgraph_free(cgraph_t *g);
+
+// is (src, dest) an edge of g??
+int cgraph_has_edge(const cgraph_t *g, int src, int dest);
+
+// a 128-bit fingerprint of the nodes and edges of g (two independent
+// 64-bit hashes of the sorted edge list, so equal graphs have equal
+// fingerprints and unequal graphs practically never collide)
+void cgraph_fingerprint(const cgraph_t *g, uint64_t fp[2]);
+
+
+
 //***************************************************************************
 
 /*
@@ -46,6 +96,13 @@
 
   ** cedges : maintains a count of the edges in the graph
 
+  ** compact : the compact view of the graph (see cgraph_t), built
+	       on demand and dropped whenever the graph changes
+
+  ** mutations : counts the changes of the structure of the graph
+		 (the nodes and the edges), so that views of the graph
+		 kept elsewhere can tell whether they are up to date
+
 
  */
 
@@ -58,12 +115,16 @@
     NSMutableDictionary *outgoing; // outgoing edges 
     NSMutableDictionary *incoming; // incoming edges 
     int cedges; // number of edges
+    cgraph_t *compact; // compact view (NULL until requested)
+    unsigned long mutations; // number of changes of the structure
 
 }
 
 
 + (id) digraphWithNodes:(int)nnodes;
 + (id) digraphFromFile:(NSString *)fname;
+// a graph with nodes 0..nodes-1 and the edges of g
++ (id) digraphFromCompact:(const cgraph_t *)g;
 
 - (id) init;
 - (id) initWithNodes:(int)nnodes;
@@ -132,6 +193,13 @@
 - (int) countNodes;
 - (int) countEdges;
 
+// the compact view of the graph (owned by the graph and valid
+// until the graph is modified)
+- (const cgraph_t *) compact;
+
+// the number of changes of the nodes and the edges so far
+- (unsigned long) mutations;
+
 // graph description as a string
 - (NSString *) description;
 
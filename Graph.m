@@ -2,6 +2,8 @@
 #import "GSL.h"
 #import "common.h"
 
+#import <string.h>
+
 
 //***************************************************************************
 @implementation Edge
@@ -42,6 +44,124 @@
 @end
 
 
+
+//***************************************************************************
+
+cgraph_t *cgraph_alloc(int nodes, int nedges, const int *from, const int *to) {
+
+  cgraph_t *g = malloc(sizeof(cgraph_t));
+  int *next = malloc(sizeof(int) * (nodes + 1));
+  int i, k;
+
+  g->nodes = nodes;
+  g->edges = nedges;
+  g->in_ptr = calloc(nodes + 1, sizeof(int));
+  g->out_ptr = calloc(nodes + 1, sizeof(int));
+  g->in = malloc(sizeof(int) * (nedges + 1));
+  g->trg = malloc(sizeof(int) * (nedges + 1));
+  g->out = malloc(sizeof(int) * (nedges + 1));
+
+  // the degrees => the offsets of the adjacency arrays
+  for (k=0; k<nedges; k++) {
+    g->in_ptr[to[k] + 1] += 1;
+    g->out_ptr[from[k] + 1] += 1;
+  }
+  for (i=0; i<nodes; i++) {
+    g->in_ptr[i + 1] += g->in_ptr[i];
+    g->out_ptr[i + 1] += g->out_ptr[i];
+  }
+
+  // (counting sorts) the successors in the order of the edges,
+  // then the predecessors of each node in increasing order ...
+  memcpy(next, g->out_ptr, sizeof(int) * nodes);
+  for (k=0; k<nedges; k++)
+    g->out[next[from[k]]++] = to[k];
+  memcpy(next, g->in_ptr, sizeof(int) * nodes);
+  for (i=0; i<nodes; i++)
+    for (k=g->out_ptr[i]; k<g->out_ptr[i + 1]; k++) {
+      g->trg[next[g->out[k]]] = g->out[k];
+      g->in[next[g->out[k]]++] = i;
+    }
+  // ... and the successors of each node in increasing order
+  memcpy(next, g->out_ptr, sizeof(int) * nodes);
+  for (k=0; k<nedges; k++)
+    g->out[next[g->in[k]]++] = g->trg[k];
+
+  free(next);
+
+  return g;
+
+}
+
+
+
+void cgraph_free(cgraph_t *g) {
+
+  if (!g)
+    return;
+
+  free(g->in_ptr);
+  free(g->in);
+  free(g->trg);
+  free(g->out_ptr);
+  free(g->out);
+  free(g);
+
+}
+
+
+
+int cgraph_has_edge(const cgraph_t *g, int src, int dest) {
+
+  int lo = g->in_ptr[dest], hi = g->in_ptr[dest + 1], mid;
+
+  // binary search in the (sorted) predecessors of dest
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (g->in[mid] < src)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo < g->in_ptr[dest + 1] && g->in[lo] == src;
+
+}
+
+
+
+// the finalizer of splitmix64
+static uint64_t mix64(uint64_t z) {
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+
+}
+
+
+
+void cgraph_fingerprint(const cgraph_t *g, uint64_t fp[2]) {
+
+  uint64_t h1 = mix64(0x243F6A8885A308D3ULL + (uint64_t)g->nodes);
+  uint64_t h2 = mix64(0x13198A2E03707344ULL + (uint64_t)g->edges);
+  uint64_t e;
+  int k;
+
+  // the edges are sorted, so their sequence identifies the graph
+  for (k=0; k<g->edges; k++) {
+    e = (uint64_t)g->in[k] * g->nodes + g->trg[k] + 1;
+    h1 = mix64(h1 ^ (e * 0x9E3779B97F4A7C15ULL));
+    h2 = mix64(h2 + (e * 0xC2B2AE3D27D4EB4FULL) + k);
+  }
+
+  fp[0] = h1;
+  fp[1] = h2;
+
+}
+
+
+
 //***************************************************************************
 
 @implementation Digraph
@@ -54,6 +174,20 @@
 }
 
 
++ (id) digraphFromCompact:(const cgraph_t *)g {
+
+  Digraph *graph = [Digraph digraphWithNodes:g->nodes];
+  int k;
+
+  for (k=0; k<g->edges; k++)
+    [graph addEdgeFrom:[NSNumber numberWithInt:g->in[k]]
+		    To:[NSNumber numberWithInt:g->trg[k]]];
+
+  return graph;
+
+}
+
+
 + (id) digraphFromFile:(NSString *)fname {
 
   // does file exist??
@@ -113,6 +247,8 @@
   incoming = [[NSMutableDictionary alloc] init];
 
   cedges = 0;
+  compact = NULL;
+  mutations = 0;
 
   return self;
 
@@ -144,6 +280,7 @@
   [nattrs release];
   [outgoing release];
   [incoming release];
+  cgraph_free(compact);
   [super dealloc];
 
 }
@@ -167,6 +304,11 @@
     return;
   }
 
+  // the compact view is out of date
+  cgraph_free(compact);
+  compact = NULL;
+  mutations += 1;
+
   // add the node to nodes array
   [nodes addObject:node];
 
@@ -212,6 +354,10 @@
     // just update the attributes of existing node
     [d addEntriesFromDictionary:attrs];
   else if (attrs) { // is attrs non nil?? 
+    // the compact view is out of date
+    cgraph_free(compact);
+    compact = NULL;
+    mutations += 1;
     // add entry for edge associated with attrs
     [[outgoing objectForKey:src] setObject:attrs
 				    forKey:dest];
@@ -221,6 +367,10 @@
     cedges += 1;
     
   } else {
+    // the compact view is out of date
+    cgraph_free(compact);
+    compact = NULL;
+    mutations += 1;
     // add entry for edge with empty attributes
     [[outgoing objectForKey:src] setObject:[NSMutableDictionary dictionary]
 				    forKey:dest];
@@ -240,6 +390,10 @@
   NSMutableDictionary *d = [[outgoing objectForKey:src] objectForKey:dest];
   // does edge exist??
   if (d) {
+    // the compact view is out of date
+    cgraph_free(compact);
+    compact = NULL;
+    mutations += 1;
     [[outgoing objectForKey:src] removeObjectForKey:dest];
     [[incoming objectForKey:dest] removeObjectForKey:src];
     // reduce edge count
@@ -255,7 +409,12 @@
   NSArray *preds = [self predecessorsOfNode:dest];
   int i;
   id src;
-    
+
+  // the compact view is out of date
+  cgraph_free(compact);
+  compact = NULL;
+  mutations += 1;
+
   // remove entries of the form (src, dest) in outgoing dict
   for (i=0; i < [preds count]; i++) {
     // get source node for dest
@@ -277,7 +436,12 @@
   NSArray *succs = [self successorsOfNode:src];
   int i;
   id dest;
-    
+
+  // the compact view is out of date
+  cgraph_free(compact);
+  compact = NULL;
+  mutations += 1;
+
   // remove entries of the form (src, dest) in incoming dict
   for (i=0; i < [succs count]; i++) {
     // get dest node for src
@@ -299,6 +463,11 @@
   NSArray *keys;
   int i;
 
+  // the compact view is out of date
+  cgraph_free(compact);
+  compact = NULL;
+  mutations += 1;
+
   // remove all edges from outgoing dictionary
   keys = [outgoing allKeys];
   for (i=0; i<[keys count]; i++)
@@ -503,6 +672,57 @@
 }
 
 
+
+- (const cgraph_t *) compact {
+
+  int n = [nodes count], i, j, k = 0, src;
+  int *from, *to;
+  char *seen;
+  NSArray *dests;
+
+  if (compact)
+    return compact;
+
+  // the dense id of a node is its value; the nodes must be 0..n-1
+  // (in any order, e.g. those of digraphFromFile:)
+  seen = calloc(n, 1);
+  for (i=0; i<n; i++) {
+    src = [[nodes objectAtIndex:i] intValue];
+    NSAssert(src >= 0 && src < n && !seen[src],
+	     @"The nodes of a compact graph must be 0..nodes-1");
+    seen[src] = 1;
+  }
+  free(seen);
+
+  from = malloc(sizeof(int) * (cedges + 1));
+  to = malloc(sizeof(int) * (cedges + 1));
+  for (i=0; i<n; i++) {
+    src = [[nodes objectAtIndex:i] intValue];
+    dests = [[outgoing objectForKey:[nodes objectAtIndex:i]] allKeys];
+    for (j=0; j<[dests count]; j++) {
+      from[k] = src;
+      to[k] = [[dests objectAtIndex:j] intValue];
+      k++;
+    }
+  }
+
+  compact = cgraph_alloc(n, cedges, from, to);
+  free(from);
+  free(to);
+
+  return compact;
+
+}
+
+
+
+- (unsigned long) mutations {
+
+  return mutations;
+
+}
+
+
 - (NSString *) description {
 
   NSMutableString *desc = [NSMutableString string];
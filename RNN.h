@@ -12,6 +12,12 @@ so w[i,j] indicates how target node i is regulated by regulator node j
  */
 
 
+// TRAINING MODES (see setTrainMode:withGradSettings:)
+#define TRAIN_PSO 0 // PSO only
+#define TRAIN_HYBRID 1 // PSO followed by a gradient refinement of gbest
+#define TRAIN_GRADIENT 2 // gradient minimization only (no PSO)
+
+
 
 
 //***************************************************************
@@ -24,6 +30,21 @@ so w[i,j] indicates how target node i is regulated by regulator node j
     GSLMatrix *W; // weight matrix
     GSLVector *B; // bias vector
 
+    // sparse view of W (see predict.h) -- available only 
+    // when the parameters have been set using a graph
+    struct predict_csr *csr;
+    Digraph *csr_graph; // the graph that corresponds to csr
+    unsigned long csr_mutations; // the mutations of csr_graph by then
+
+    // the prior parameters that seed the graph trainings
+    // (see setWarmStart:) -- nil for a cold start
+    RNN *warm;
+
+    // the optimization of the training problems
+    int train_mode; // see the TRAINING MODES above
+    grad_settings_t grad_settings; // the gradient minimization settings
+    long evals; // the PSO objective evaluations of the trainings so far
+
 }
 
 // create an RNN
@@ -79,6 +100,8 @@ so w[i,j] indicates how target node i is regulated by regulator node j
 - (GSLMatrix *) W;
 - (GSLVector *) B;
 - (int) nodes;
+- (const struct predict_csr *) csr; // NULL if W is dense
+- (RNN *) warmStart;
 
 // setters
 - (void) setFromVector:(GSLVector *)vec;
@@ -91,6 +114,32 @@ so w[i,j] indicates how target node i is regulated by regulator node j
 	     withGraph:(Digraph *)graph
 	       forNode:(int)row;
 
+// return the parameters of node row for the regulators regs
+// i.e. the inverse of setFromVector:withGraph:forNode: for a
+// graph where the predecessors of row are regs (in this order)
+- (GSLVector *) vectorForNode:(int)row
+	       withRegulators:(NSArray *)regs;
+
+// return the parameters that correspond to graph
+// i.e. the inverse of setFromVector:withGraph:
+- (GSLVector *) vectorWithGraph:(Digraph *)graph;
+
+// seed the graph trainings with the parameters of prior (nil : off)
+// the initial swarm contains prior's parameters for the trained
+// graph, i.e. the regulators that are shared with prior keep their
+// weights and the new regulators start at zero
+- (void) setWarmStart:(RNN *)prior;
+
+// set the training mode (TRAIN_PSO by default) and the settings of
+// the gradient minimization (NULL : default settings)
+// the gradient-only mode starts from zero weights and bias terms and
+// unit time constants (or from the warm start parameters, if any)
+- (void) setTrainMode:(int)mode
+     withGradSettings:(grad_settings_t *)gs;
+
+// the number of PSO objective evaluations of the trainings so far
+- (long) evaluations;
+
 
 // ===========================================================
 //                  TRAINING FUNCTIONS
@@ -122,6 +171,29 @@ so w[i,j] indicates how target node i is regulated by regulator node j
 		     withGraph:(Digraph *)graph
 	       withPSOSettings:(pso_settings_t *)pso_settings;
 
+// train the parameters of node i that correspond to graph
+// using TDYN (training data) -- the rest of the RNN is not affected
+// returns the minimum achieved optimization error
+- (double) trainNode:(int)i
+       usingDynamics:(Dynamics *)tdyn
+	   withGraph:(Digraph *)graph
+     withPSOSettings:(pso_settings_t *)pso_settings;
+
+
+// fit the parameters of node i that correspond to graph using
+// TDYN (training data) by linear least squares on the logit of the
+// target's values, i.e. logit(x_i(t)) = sum_j w_ij x_j(t-1) + b_i
+// (the time constant of a DRNN is set to delta_t, i.e. no decay)
+// returns the prediction MSE of the node
+- (double) fitNode:(int)i
+     usingDynamics:(Dynamics *)tdyn
+	 withGraph:(Digraph *)graph;
+
+// fit all nodes of the RNN that corresponds to graph (as above)
+// returns the mean across the per-target prediction errors
+- (double) fitUsingDynamics:(Dynamics *)tdyn
+		  withGraph:(Digraph *)graph;
+
 // ===========================================================
 
 
@@ -133,6 +205,12 @@ so w[i,j] indicates how target node i is regulated by regulator node j
 - (Dynamics *)predict:(Dynamics *)adyn
 	    forTarget:(int)trg;
 
+// calculate the pre-activations of target trg for time points 
+// 1..tpoints-1 of adyn (u must hold tpoints-1 values)
+- (void) preactivations:(double *)u
+	       ofTarget:(int)trg
+		  given:(Dynamics *)adyn;
+
 - (NSString *) description;
 
 @end
@@ -201,6 +279,7 @@ so w[i,j] indicates how target node i is regulated by regulator node j
 
 // getters
 - (GSLVector *) T;
+- (double) deltaT;
 
 - (void) setDeltaT:(double)val;
 
@@ -217,6 +296,11 @@ so w[i,j] indicates how target node i is regulated by regulator node j
 	     withGraph:(Digraph *)graph
 	       forNode:(int)row;
 
+- (GSLVector *) vectorForNode:(int)row
+	       withRegulators:(NSArray *)regs;
+
+- (GSLVector *) vectorWithGraph:(Digraph *)graph;
+
 
 
 
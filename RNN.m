@@ -1,30 +1,129 @@
 #import <Foundation/Foundation.h>
 #import <math.h> // for pow(), sqrt()
+#import <string.h> // for memcpy()
+#import <pthread.h>
+#import <gsl/gsl_multifit.h>
 
 #import "GSL.h"
 #import "Dynamics.h"
 #import "Graph.h"
 #import "pso.h"
+#import "grad.h"
 #import "RNN.h"
+#import "predict.h"
+#import "activation.h"
 
 
 #import "common.h"
 
 #define RNN_DELTA_T 1
 
+// the values of the targets are clamped in [LS_EPS, 1 - LS_EPS]
+// before taking their logit (see fit_logit_ls())
+#define LS_EPS 1e-3
+
 
 //***************************************************************
-// static struct variable : details of rnn under training
+// training context : details of the rnn under training
+// (passed to the PSO objective functions through params)
 //***************************************************************
-static struct {
+typedef struct {
+
+    const gsl_matrix *tdata; // the training data
+    int nodes; // number of nodes of the RNN under training
+    int decay; // whether the RNN has time constants (DRNN)
+    double delta_t; // the DRNN's delta_t
+
+    // training with a graph (all nodes)
+    const predict_csr_t *csr; // the sparse structure of the weights
+
+    // per-node training
+    int target; // the current target node
+    const int *regs; // the regulators of target (NULL for all nodes)
+    int nregs; // the number of regulators of target
 
-    id rnn; // the RNN under training
-    GSLVector *vec; // vector of parameter values
-    Dynamics *tdata; // the training data
-    Digraph *graph; // the corresponding graph
-    int target; // the current target node (for per-node training)
+} train_ctx_t;
 
-} t_rnn;
+
+// initialize the common members of ctx for rnn
+static void init_train_ctx(train_ctx_t *ctx, RNN *rnn, Dynamics *tdyn) {
+
+    memset(ctx, 0, sizeof(train_ctx_t));
+    ctx->tdata = [tdyn matrix];
+    ctx->nodes = [rnn nodes];
+    ctx->decay = [rnn isKindOfClass:[DRNN class]];
+    ctx->delta_t = ctx->decay ? [(DRNN *)rnn deltaT] : 0;
+
+}
+
+
+
+//***************************************************************
+// scratch space of the objective functions :: each thread that
+// evaluates objective functions has its own (grown on demand)
+//***************************************************************
+typedef struct {
+
+    gsl_matrix *pdata; // predicted dynamics (of a batch of particles)
+    gsl_matrix *ws; // the weight matrices of a batch of particles
+    double *wk; // the (sparse) weights of a batch of particles
+    size_t wk_size; // the size of wk
+
+} train_scratch_t;
+
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+
+static void free_scratch(void *ptr) {
+
+    train_scratch_t *scr = ptr;
+
+    if (scr->pdata)
+	gsl_matrix_free(scr->pdata);
+    if (scr->ws)
+	gsl_matrix_free(scr->ws);
+    free(scr->wk);
+    free(scr);
+
+}
+
+
+static void make_scratch_key(void) {
+
+    pthread_key_create(&scratch_key, free_scratch);
+
+}
+
+
+// make sure that m is (at least) a rows x cols matrix
+static gsl_matrix *grow_matrix(gsl_matrix *m, size_t rows, size_t cols) {
+
+    if (m && m->size1 == rows && m->size2 >= cols)
+	return m;
+    if (m)
+	gsl_matrix_free(m);
+    return gsl_matrix_alloc(rows, cols);
+
+}
+
+
+// return the scratch space of the calling thread
+static train_scratch_t *get_scratch(void) {
+
+    train_scratch_t *scr;
+
+    pthread_once(&scratch_once, make_scratch_key);
+    scr = pthread_getspecific(scratch_key);
+    if (!scr) {
+	scr = calloc(1, sizeof(train_scratch_t));
+	pthread_setspecific(scratch_key, scr);
+    }
+
+    return scr;
+
+}
 
 
 
@@ -32,75 +131,279 @@ static struct {
 //          OBJECTIVE FUNCTIONS FOR PSO
 //***************************************************************
 
+// NOTE : the objective functions are re-entrant; they only read
+// the training context (params) and write to the scratch space of
+// the calling thread, so PSO can evaluate particles concurrently
+
 
 // PSO objective function (for training)
 // training the full weight matrix 
-double global_pso_obj_fun(double *vec, size_t dim, void *params) {
-
-    // set RNN param values from vector
-    [t_rnn.rnn setFromVector:[t_rnn.vec fillFromCArray:vec
-					      withSize:dim]];
-    // predict training data (stored in static global variable)
-    // using static global rnn
-    Dynamics *pdata = [t_rnn.rnn predict:t_rnn.tdata];
-    // return prediction MSE
-    return [t_rnn.tdata calcMSEwith:pdata];
+// (evaluates a batch of particles at once)
+void global_pso_obj_fun(double *pos, int count, size_t dim, 
+			double *fit, void *params) {
+
+    train_ctx_t *ctx = params;
+    train_scratch_t *scr = get_scratch();
+    int n = ctx->nodes;
+    int m, i;
+    double *vec;
+    const double *b[count], *t[count];
+
+    scr->pdata = grow_matrix(scr->pdata, ctx->tdata->size1, count * n);
+    scr->ws = grow_matrix(scr->ws, count * n, n);
+
+    // each position starts with the weight matrix (row-wise),
+    // followed by the bias terms and the time constants
+    for (m=0; m<count; m++) {
+	vec = pos + m * dim;
+	// stack the weight matrices of the batch
+	for (i=0; i<n; i++)
+	    memcpy(gsl_matrix_ptr(scr->ws, m * n + i, 0), vec + i * n, 
+		   sizeof(double) * n);
+	b[m] = vec + n * n;
+	t[m] = vec + n * (n + 1);
+    }
+    // predict training data directly from the positions
+    // and store the prediction MSEs
+    predict_batch_mse(ctx->tdata, scr->ws, b,
+		      ctx->decay ? t : NULL, ctx->delta_t,
+		      count, scr->pdata, fit);
 
 }
 
 
 // PSO objective function (for training)
-// training the weight matrix corresponding to t_rnn.graph
-double global_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
+// training the weight matrix corresponding to a graph (ctx->csr)
+// (evaluates a batch of particles at once)
+void global_pso_obj_fun_with_graph(double *pos, int count, size_t dim, 
+				   double *fit, void *params) {
+
+    train_ctx_t *ctx = params;
+    train_scratch_t *scr = get_scratch();
+    const predict_csr_t *csr = ctx->csr;
+    int n = ctx->nodes;
+    int nnz = csr->nnz;
+    int m, i;
+    double *vec;
+    const double *b[count], *t[count];
+
+    scr->pdata = grow_matrix(scr->pdata, ctx->tdata->size1, count * n);
+    if (scr->wk_size < count * nnz) {
+	free(scr->wk);
+	scr->wk_size = count * nnz;
+	scr->wk = malloc(sizeof(double) * (scr->wk_size + 1));
+    }
 
-    // set RNN param values from vector
-    [t_rnn.rnn setFromVector:[t_rnn.vec fillFromCArray:vec
-					      withSize:dim]
-		   withGraph:t_rnn.graph];
-    // predict training data (stored in static global variable)
-    // using static global rnn
-    Dynamics *pdata = [t_rnn.rnn predict:t_rnn.tdata];
-    // return prediction MSE
-    return [t_rnn.tdata calcMSEwith:pdata];
+    // each position starts with the weights (in graph edge order),
+    // followed by the bias terms and the time constants
+    for (m=0; m<count; m++) {
+	vec = pos + m * dim;
+	// rearrange the weights of the batch in csr order
+	for (i=0; i<nnz; i++)
+	    scr->wk[m * nnz + csr->edge[i]] = vec[i];
+	b[m] = vec + nnz;
+	t[m] = vec + nnz + n;
+    }
+    // predict training data directly from the positions
+    // and store the prediction MSEs
+    predict_batch_csr_mse(ctx->tdata, csr, scr->wk, b,
+			  ctx->decay ? t : NULL, ctx->delta_t,
+			  count, scr->pdata, fit);
 
 }
 
 
 // PSO objective function (for training)
-// per-node training of RNN 
-double local_pso_obj_fun(double *vec, size_t dim, void *params) {
+// per-node training of RNN (with or without a graph)
+// vec holds the weights of the target's regulators (ctx->regs),
+// followed by the bias term and the time constant
+// the evaluation is abandoned as soon as the MSE exceeds cutoff
+double local_pso_obj_fun(double *vec, size_t dim, double cutoff, 
+			 void *params) {
+
+    train_ctx_t *ctx = params;
+    int k = ctx->nregs;
+    double alpha = ctx->decay ? ctx->delta_t / vec[k+1] : 0;
+    // predict training data for current node directly from the
+    // parameter vector and return prediction MSE
+    return predict_target_mse(ctx->tdata, ctx->target,
+			      ctx->regs, vec, k, vec[k],
+			      ctx->decay ? &alpha : NULL,
+			      cutoff);
+
+}
+
 
-    // set RNN param values from vector
-    [t_rnn.rnn setFromVector:[GSLVector vectorFromCArray:vec
-						withSize:dim]
-		     forNode:t_rnn.target];
-    // predict training data (stored in static global variable)
-    // for current node
-    // using static global rnn
-    Dynamics *pdata = [t_rnn.rnn predict:t_rnn.tdata
-			       forTarget:t_rnn.target];
-    // return prediction MSE
-    return [t_rnn.tdata calcMSEwith:pdata
-			      ofVar:t_rnn.target];
+
+//***************************************************************
+//          OBJECTIVE FUNCTIONS FOR GRADIENT MINIMIZATION
+//***************************************************************
+
+// NOTE : the parameter vectors have the same layout as the PSO
+// positions above; the one-step-ahead prediction error of a target
+// depends on the parameters of the target only, so the gradients
+// are assembled from the gradients of the targets (see predict.h)
+
+
+// gradient objective function (for training)
+// training the full weight matrix
+double global_grad_obj_fun(const double *x, size_t dim, double *grad,
+			   void *params) {
+
+    train_ctx_t *ctx = params;
+    int n = ctx->nodes;
+    int i, k;
+    double g[n + 2]; // the gradient of a target
+    double err = 0;
+
+    for (i=0; i<n; i++) {
+	err += predict_target_grad(ctx->tdata, i, NULL, x + i * n, n,
+				   x[n * n + i],
+				   ctx->decay ? x + n * (n + 1) + i : NULL,
+				   ctx->delta_t, grad ? g : NULL);
+	if (!grad)
+	    continue;
+	// the MSE is the mean across the targets
+	for (k=0; k<n; k++)
+	    grad[i * n + k] = g[k] / n;
+	grad[n * n + i] = g[n] / n;
+	if (ctx->decay)
+	    grad[n * (n + 1) + i] = g[n + 1] / n;
+    }
+
+    return err / n;
+
+}
+
+
+// gradient objective function (for training)
+// training the weight matrix corresponding to a graph (ctx->csr)
+double global_grad_obj_fun_with_graph(const double *x, size_t dim,
+				      double *grad, void *params) {
+
+    train_ctx_t *ctx = params;
+    const predict_csr_t *csr = ctx->csr;
+    int n = ctx->nodes;
+    int nnz = csr->nnz;
+    int i, k, trg, first;
+    double w[nnz + 1]; // the weights in csr order
+    int idx[nnz + 1]; // the index in x of each csr entry
+    double g[n + 2]; // the gradient of a target
+    double err = 0;
+
+    // rearrange the weights in csr order
+    for (i=0; i<nnz; i++) {
+	w[csr->edge[i]] = x[i];
+	idx[csr->edge[i]] = i;
+    }
+
+    for (trg=0; trg<n; trg++) {
+	first = csr->rowptr[trg];
+	err += predict_target_grad(ctx->tdata, trg, csr->reg + first,
+				   w + first, csr->rowptr[trg+1] - first,
+				   x[nnz + trg],
+				   ctx->decay ? x + nnz + n + trg : NULL,
+				   ctx->delta_t, grad ? g : NULL);
+	if (!grad)
+	    continue;
+	// the MSE is the mean across the targets
+	for (k=first; k<csr->rowptr[trg+1]; k++)
+	    grad[idx[k]] = g[k - first] / n;
+	grad[nnz + trg] = g[csr->rowptr[trg+1] - first] / n;
+	if (ctx->decay)
+	    grad[nnz + n + trg] = g[csr->rowptr[trg+1] - first + 1] / n;
+    }
+
+    return err / n;
+
+}
+
+
+// gradient objective function (for training)
+// per-node training of RNN (same layout as local_pso_obj_fun)
+double local_grad_obj_fun(const double *x, size_t dim, double *grad,
+			  void *params) {
+
+    train_ctx_t *ctx = params;
+    int k = ctx->nregs;
+
+    return predict_target_grad(ctx->tdata, ctx->target, ctx->regs,
+			       x, k, x[k], ctx->decay ? x + k + 1 : NULL,
+			       ctx->delta_t, grad);
+
+}
+
+
+//***************************************************************
+//          LINEAR LEAST SQUARES FIT OF A SINGLE TARGET
+//***************************************************************
+
+// fit the weights of the regulators of ctx->target and its bias
+// term to the logit of the target's values (i.e. the inverse of the
+// sigmoid) :: vec receives nregs weights followed by the bias term
+// (all zero if there are fewer time points than parameters)
+static void fit_logit_ls(const train_ctx_t *ctx, double *vec) {
+
+    const gsl_matrix *X = ctx->tdata;
+    size_t n = X->size1 - 1; // the predicted time points
+    size_t p = ctx->nregs + 1; // the parameters
+    size_t t;
+    int k;
+    double y, chisq;
+    gsl_matrix *A, *cov;
+    gsl_vector *Y, *c;
+    gsl_multifit_linear_workspace *work;
+
+    memset(vec, 0, sizeof(double) * p);
+    if (X->size1 < 2 || n < p)
+	return;
+
+    A = gsl_matrix_alloc(n, p);
+    cov = gsl_matrix_alloc(p, p);
+    Y = gsl_vector_alloc(n);
+    c = gsl_vector_alloc(p);
+    work = gsl_multifit_linear_alloc(n, p);
+
+    // one row per time point :: the regulators' previous values and
+    // a constant (bias term)
+    for (t=1; t<=n; t++) {
+	for (k=0; k<ctx->nregs; k++)
+	    gsl_matrix_set(A, t-1, k, 
+			   gsl_matrix_get(X, t-1, ctx->regs ? ctx->regs[k] : k));
+	gsl_matrix_set(A, t-1, ctx->nregs, 1.);
+	y = gsl_matrix_get(X, t, ctx->target);
+	y = (y < LS_EPS) ? LS_EPS : (y > 1. - LS_EPS) ? 1. - LS_EPS : y;
+	gsl_vector_set(Y, t-1, log(y / (1. - y)));
+    }
+
+    if (gsl_multifit_linear(A, Y, c, cov, &chisq, work) == GSL_SUCCESS)
+	memcpy(vec, c->data, sizeof(double) * p);
+
+    gsl_multifit_linear_free(work);
+    gsl_vector_free(c);
+    gsl_vector_free(Y);
+    gsl_matrix_free(cov);
+    gsl_matrix_free(A);
 
 }
 
 
-double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
-    // set RNN param values from vector
-    [t_rnn.rnn setFromVector:[GSLVector vectorFromCArray:vec
-						withSize:dim]
-		   withGraph:t_rnn.graph
-		     forNode:t_rnn.target];
-    // predict training data (stored in static global variable)
-    // for current node
-    // using static global rnn
-    Dynamics *pdata = [t_rnn.rnn predict:t_rnn.tdata
-			       forTarget:t_rnn.target];
-    // return prediction MSE
-    return [t_rnn.tdata calcMSEwith:pdata
-			    ofVar:t_rnn.target];
+// the starting position of a gradient-only training :: the seed (if
+// any) or zero weights and bias terms and unit time constants (the
+// last ntimes elements of x)
+static void init_grad_start(double *x, size_t dim, int ntimes,
+			    const double *seed) {
+
+    size_t i;
+
+    if (seed) {
+	memcpy(x, seed, sizeof(double) * dim);
+	return;
+    }
+
+    for (i=0; i<dim; i++)
+	x[i] = (i < dim - ntimes) ? 0 : 1;
 
 }
 
@@ -195,7 +498,7 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 	     withGraph:(Digraph *) graph
 {
 
-    return [graph inDegreeOfNode:[NSNumber numberWithInt:node]] + 1;
+    return CGRAPH_IN_DEGREE([graph compact], node) + 1;
 
 }
 
@@ -252,19 +555,33 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 - (void) reset {
 
+    int k;
+
     [W fillWithValue:0];
     [B fillWithValue:0];
 
+    // reset the sparse view as well
+    if (csr)
+	for (k=0; k<csr->nnz; k++)
+	    csr->w[k] = 0;
+
 }
 
 
 - (void) resetNode:(int)n {
 
+    int k;
+
     [W fillRow:n 
        withValue:0];
     [B setValue:0 
 	atIndex:n];
 
+    // reset the node's row in the sparse view
+    if (csr)
+	for (k=csr->rowptr[n]; k<csr->rowptr[n+1]; k++)
+	    csr->w[k] = 0;
+
 }
 
 
@@ -273,6 +590,9 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
     [W release];
     [B release];
+    predict_csr_free(csr);
+    [csr_graph release];
+    [warm release];
     [super dealloc];
 
 }
@@ -302,6 +622,103 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 
 
+- (const struct predict_csr *) csr {
+
+    return csr;
+
+}
+
+
+
+- (RNN *) warmStart {
+
+    return warm;
+
+}
+
+
+
+- (void) setWarmStart:(RNN *)prior {
+
+    [prior retain];
+    [warm release];
+    warm = prior;
+
+}
+
+
+
+- (long) evaluations {
+
+    return evals;
+
+}
+
+
+
+- (void) setTrainMode:(int)mode
+     withGradSettings:(grad_settings_t *)gs
+{
+
+    train_mode = mode;
+    if (gs)
+	grad_settings = *gs;
+    else
+	grad_set_default_settings(&grad_settings);
+
+}
+
+
+
+// drop the sparse view of W (W is about to become dense)
+- (void) clearCSR {
+
+    predict_csr_free(csr);
+    csr = NULL;
+    [csr_graph release];
+    csr_graph = nil;
+
+}
+
+
+
+// (re)build the sparse view of W that corresponds to graph
+// the weights of the view are initialized from W
+// returns YES if the view was rebuilt
+- (BOOL) updateCSRWithGraph:(Digraph *)graph {
+
+    const cgraph_t *g = [graph compact];
+    int trg, k;
+
+    // is the view up to date?? (the same graph, unchanged since)
+    if (csr && graph == csr_graph && [graph mutations] == csr_mutations)
+	return NO;
+
+    predict_csr_free(csr);
+    csr = predict_csr_alloc(nodes, [graph countEdges]);
+
+    // the rows are the (sorted) regulators of each target, i.e. the
+    // compact view of the graph, so the entry of edge k is k
+    memcpy(csr->rowptr, g->in_ptr, sizeof(int) * (nodes + 1));
+    memcpy(csr->reg, g->in, sizeof(int) * g->edges);
+    for (trg=0; trg<nodes; trg++)
+	for (k=csr->rowptr[trg]; k<csr->rowptr[trg+1]; k++) {
+	    csr->w[k] = [W valueAtRow:trg andColumn:csr->reg[k]];
+	    csr->edge[k] = k;
+	}
+
+    // remember the graph
+    [graph retain];
+    [csr_graph release];
+    csr_graph = graph;
+    csr_mutations = [graph mutations];
+
+    return YES;
+
+}
+
+
+
 
 
 // setters
@@ -316,6 +733,9 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // reset RNN values
     //[self reset]; --> NOT NEEDED HERE
 
+    // W becomes dense
+    [self clearCSR];
+
     // initialize vec's index
     vec_idx = 0;
 
@@ -342,31 +762,30 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 	     withGraph:(Digraph *)graph
 {
 
-    int i, vec_idx;
+    int i, k, trg, vec_idx;
     // figure out number of nodes
     //int n = [graph countNodes];
     // make sure this is correct
     //NSAssert(n == nodes, @"Dimensionality mismatch!!");
 
-    // reset all parameter values
-    [self reset];
+    // update the sparse view of W; the weights that do not 
+    // correspond to graph edges are reset only when the graph changes
+    if ([self updateCSRWithGraph:graph])
+	[self reset];
 
     // initialize index to vec
     vec_idx = 0;
 
-    // get graph edges
-    NSArray *edges = [graph edges];
-    int n_e = [edges count];
-    Edge *e;
-
     // read in weight values (corresponding to graph edges)
-    for (i=0; i<n_e; i++) {
-	// get the edge
-	e = [edges objectAtIndex:i];
-	[W setValue:[vec valueAtIndex:vec_idx++]
-	      atRow:[[e to] intValue] // rows are targets
-	  andColumn:[[e from] intValue]]; // cols are regulators
-    }
+    for (i=0; i<csr->nnz; i++)
+	csr->w[csr->edge[i]] = [vec valueAtIndex:vec_idx++];
+
+    // copy the weights to W (rows are targets, cols are regulators)
+    for (trg=0; trg<nodes; trg++)
+	for (k=csr->rowptr[trg]; k<csr->rowptr[trg+1]; k++)
+	    [W setValue:csr->w[k]
+		  atRow:trg
+	      andColumn:csr->reg[k]];
 
     // read in bias vector
     for (i=0; i<nodes; i++)
@@ -388,6 +807,9 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // reset RNN values
     //[self reset]; --> NOT NEEDED HERE
 
+    // the node's row becomes dense
+    [self clearCSR];
+
     // initialize vec's index
     vec_idx = 0;
 
@@ -411,7 +833,10 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 	       forNode:(int)row
 {
 
-    int vec_idx;
+    int k, vec_idx;
+
+    // update the sparse view of W
+    [self updateCSRWithGraph:graph];
 
     // reset the node's parameter values 
     [self resetNode:row];
@@ -419,15 +844,14 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // initialize index to vec
     vec_idx = 0;
 
-    // get graph edges (array of NSNumbers)
-    NSEnumerator *regs = [[graph predecessorsOfNode:[NSNumber numberWithInt:row]]
-			     objectEnumerator];
-    NSNumber *reg;
-    while ((reg = [regs nextObject]))
-	[W setValue:[vec valueAtIndex:vec_idx++]
+    // read in the weights of the node's regulators
+    // (csr row, in increasing order)
+    for (k=csr->rowptr[row]; k<csr->rowptr[row+1]; k++) {
+	csr->w[k] = [vec valueAtIndex:vec_idx++];
+	[W setValue:csr->w[k]
 	      atRow:row
-	  andColumn:[reg intValue]];
-    
+	  andColumn:csr->reg[k]];
+    }
 
     // read in bias term value
     [B setValue:[vec valueAtIndex:vec_idx]
@@ -439,6 +863,55 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 
 
+// getters
+- (GSLVector *) vectorForNode:(int)row
+	       withRegulators:(NSArray *)regs
+{
+
+    int k, nregs = [regs count];
+    GSLVector *vec = [GSLVector vectorWithSize:[[self class] calcDimOfSingleNodeForNodes:nregs]];
+
+    // the weights of the regulators (in the order of regs)
+    for (k=0; k<nregs; k++)
+	[vec setValue:[W valueAtRow:row
+			  andColumn:[[regs objectAtIndex:k] intValue]]
+	      atIndex:k];
+
+    // the bias term
+    [vec setValue:[B valueAtIndex:row]
+	  atIndex:nregs];
+
+    return vec;
+
+}
+
+
+
+- (GSLVector *) vectorWithGraph:(Digraph *)graph {
+
+    int i, vec_idx = 0;
+    const cgraph_t *g = [graph compact];
+    GSLVector *vec = [GSLVector vectorWithSize:[[self class] calcDimForGraph:graph]];
+
+    // the weights of the graph edges (in compact edge order)
+    for (i=0; i<g->edges; i++)
+	[vec setValue:[W valueAtRow:g->trg[i]
+			  andColumn:g->in[i]]
+	      atIndex:vec_idx++];
+
+    // the bias vector
+    for (i=0; i<nodes; i++)
+	[vec setValue:[B valueAtIndex:i]
+	      atIndex:vec_idx++];
+
+    return vec;
+
+}
+
+
+
+
+
 // train the RNN against TDYN (training data)
 // returns the minimum achieved optimization error
 - (double) trainUsingDynamics:(Dynamics *)tdyn
@@ -451,10 +924,9 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // set objective function
     //pso_settings->fun = &global_pso_obj_fun;
 
-    // set values of static t_rnn object
-    t_rnn.rnn = self;
-    t_rnn.vec = [[GSLVector alloc] initWithSize:pso_settings->dim];
-    t_rnn.tdata = tdyn;
+    // set up training context
+    train_ctx_t ctx;
+    init_train_ctx(&ctx, self, tdyn);
 
 
     // create solution
@@ -462,16 +934,22 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     double gbest[pso_settings->dim];
     solution.gbest = gbest;
 
-    // run PSO
-    pso_solve(global_pso_obj_fun, NULL, &solution, pso_settings);
+    // run PSO (unless the training is gradient-only)
+    if (train_mode != TRAIN_GRADIENT) {
+	pso_solve_batch(global_pso_obj_fun, &ctx, &solution, pso_settings);
+	evals += solution.evals;
+    } else
+	init_grad_start(gbest, pso_settings->dim, ctx.decay ? nodes : 0, NULL);
+
+    // gradient minimization (starting from gbest)
+    if (train_mode != TRAIN_PSO)
+	solution.error = grad_minimize(global_grad_obj_fun, &ctx, gbest,
+				       pso_settings->dim, &grad_settings);
 
     // replace current RNN values with trained values
     [self setFromVector:[GSLVector vectorFromCArray:gbest
 					   withSize:pso_settings->dim]];
 
-    // release temporary vector
-    [t_rnn.vec release];
-
     return solution.error;
 
 }
@@ -495,28 +973,37 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 	// set objective function
 	//pso_settings->fun = &local_pso_obj_fun;
 
-	// set values of static t_rnn object
-	t_rnn.rnn = self;
-	t_rnn.vec = [[GSLVector alloc] initWithSize:pso_settings->dim];
-	t_rnn.tdata = tdyn;
-	t_rnn.target = i;
+	// set up training context
+	train_ctx_t ctx;
+	init_train_ctx(&ctx, self, tdyn);
+	ctx.target = i;
+	// all nodes regulate the target
+	ctx.regs = NULL;
+	ctx.nregs = nodes;
 
 	// create solution
 	pso_result_t solution;
 	double gbest[pso_settings->dim];
 	solution.gbest = gbest;
 
-	// run PSO
-	pso_solve(local_pso_obj_fun, NULL, &solution, pso_settings);
+	// run PSO (unless the training is gradient-only)
+	if (train_mode != TRAIN_GRADIENT) {
+	    pso_solve_with_cutoff(local_pso_obj_fun, &ctx, &solution, 
+				  pso_settings);
+	    evals += solution.evals;
+	} else
+	    init_grad_start(gbest, pso_settings->dim, ctx.decay, NULL);
+
+	// gradient minimization (starting from gbest)
+	if (train_mode != TRAIN_PSO)
+	    solution.error = grad_minimize(local_grad_obj_fun, &ctx, gbest,
+					   pso_settings->dim, &grad_settings);
 
 	// replace current RNN values with trained values
 	[self setFromVector:[GSLVector vectorFromCArray:gbest
 					       withSize:pso_settings->dim]
 		    forNode:i];
 
-	// release temporary vector
-	[t_rnn.vec release];
-
 	// store optimization error
 	[errors setValue:solution.error 
 		 atIndex:i];
@@ -544,11 +1031,13 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // set objective function
     //pso_settings->fun = &global_pso_obj_fun_with_graph;
 
-    // set values of static t_rnn object
-    t_rnn.rnn = self;
-    t_rnn.vec = [[GSLVector alloc] initWithSize:pso_settings->dim];
-    t_rnn.tdata = tdyn;
-    t_rnn.graph = graph;
+    // the sparse structure of the weights (shared by all particles)
+    [self updateCSRWithGraph:graph];
+
+    // set up training context
+    train_ctx_t ctx;
+    init_train_ctx(&ctx, self, tdyn);
+    ctx.csr = csr;
 
 
     // create solution
@@ -556,17 +1045,35 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     double gbest[pso_settings->dim];
     solution.gbest = gbest;
 
-    // run PSO
-    pso_solve(global_pso_obj_fun_with_graph, NULL, &solution, pso_settings);
+    // warm start :: seed the swarm with the prior parameters
+    GSLVector *seed = warm ? [warm vectorWithGraph:graph] : nil;
+    pso_settings->seeds = seed ? [seed vec]->data : NULL;
+    pso_settings->n_seeds = seed ? 1 : 0;
+
+    // run PSO (unless the training is gradient-only)
+    if (train_mode != TRAIN_GRADIENT) {
+	pso_solve_batch(global_pso_obj_fun_with_graph, &ctx, 
+			&solution, pso_settings);
+	evals += solution.evals;
+    } else
+	init_grad_start(gbest, pso_settings->dim, ctx.decay ? nodes : 0, 
+			pso_settings->seeds);
+
+    // the seeds are specific to this problem
+    pso_settings->seeds = NULL;
+    pso_settings->n_seeds = 0;
+
+    // gradient minimization (starting from gbest)
+    if (train_mode != TRAIN_PSO)
+	solution.error = grad_minimize(global_grad_obj_fun_with_graph, &ctx,
+				       gbest, pso_settings->dim, 
+				       &grad_settings);
 
     // replace current RNN values with trained values
     [self setFromVector:[GSLVector vectorFromCArray:gbest
 					   withSize:pso_settings->dim]
 	      withGraph:graph];
 
-    // release temporary vector
-    [t_rnn.vec release];
-
     return solution.error;
     
 }
@@ -585,46 +1092,152 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     int i;
     GSLVector *errors = [GSLVector vectorWithSize:nodes];
 
-    for (i=0; i<nodes; i++) {
+    for (i=0; i<nodes; i++)
+	// train i^th sub-problem and store optimization error
+	[errors setValue:[self trainNode:i
+			   usingDynamics:tdyn
+			       withGraph:graph
+			 withPSOSettings:pso_settings]
+		 atIndex:i];
 
-	// calculate dimensionality of i^th sub-problem
-	pso_settings->dim = [[self class] calcDimForNode:i
-					       withGraph:graph];
+    // return the mean across the per-target optimization errors
+    return [errors mean];
 
-	// set objective function
-	//pso_settings->fun = &local_pso_obj_fun_with_graph;
+}
 
-	// set values of static t_rnn object
-	t_rnn.rnn = self;
-	t_rnn.vec = [[GSLVector alloc] initWithSize:pso_settings->dim];
-	t_rnn.tdata = tdyn;
-	t_rnn.graph = graph;
-	t_rnn.target = i;
 
-	// create solution
-	pso_result_t solution;
-	double gbest[pso_settings->dim];
-	solution.gbest = gbest;
 
-	// run PSO
-	pso_solve(local_pso_obj_fun_with_graph, NULL, &solution, pso_settings);
+// train the parameters of node i that correspond to graph
+// using TDYN (training data)
+// returns the minimum achieved optimization error
+- (double) trainNode:(int)i
+       usingDynamics:(Dynamics *)tdyn
+	   withGraph:(Digraph *)graph
+     withPSOSettings:(pso_settings_t *)pso_settings
+{
 
-	// replace current RNN values with trained values
-	[self setFromVector:[GSLVector vectorFromCArray:gbest
-					       withSize:pso_settings->dim]
-		  withGraph:graph
-		    forNode:i];
+    // calculate dimensionality of i^th sub-problem
+    pso_settings->dim = [[self class] calcDimForNode:i
+					   withGraph:graph];
 
-	// release temporary vector
-	[t_rnn.vec release];
+    // set objective function
+    //pso_settings->fun = &local_pso_obj_fun;
 
-	// store optimization error
-	[errors setValue:solution.error 
-		 atIndex:i];
+    // get the regulators of the target (in increasing order)
+    const cgraph_t *g = [graph compact];
+
+    // set up training context
+    train_ctx_t ctx;
+    init_train_ctx(&ctx, self, tdyn);
+    ctx.target = i;
+    ctx.regs = g->in + g->in_ptr[i];
+    ctx.nregs = CGRAPH_IN_DEGREE(g, i);
 
+    // create solution
+    pso_result_t solution;
+    double gbest[pso_settings->dim];
+    solution.gbest = gbest;
+
+    // warm start :: seed the swarm with the prior parameters of the
+    // target (the prior weights of the new regulators are zero)
+    GSLVector *seed = nil;
+    int k;
+    NSMutableArray *preds;
+    if (warm) {
+	preds = [NSMutableArray arrayWithCapacity:ctx.nregs];
+	for (k=0; k<ctx.nregs; k++)
+	    [preds addObject:[NSNumber numberWithInt:ctx.regs[k]]];
+	seed = [warm vectorForNode:i withRegulators:preds];
     }
+    pso_settings->seeds = seed ? [seed vec]->data : NULL;
+    pso_settings->n_seeds = seed ? 1 : 0;
+
+    // run PSO (unless the training is gradient-only)
+    if (train_mode != TRAIN_GRADIENT) {
+	pso_solve_with_cutoff(local_pso_obj_fun, &ctx, &solution, 
+			      pso_settings);
+	evals += solution.evals;
+    } else
+	init_grad_start(gbest, pso_settings->dim, ctx.decay, 
+			pso_settings->seeds);
+
+    // the seeds are specific to this problem
+    pso_settings->seeds = NULL;
+    pso_settings->n_seeds = 0;
+
+    // gradient minimization (starting from gbest)
+    if (train_mode != TRAIN_PSO)
+	solution.error = grad_minimize(local_grad_obj_fun, &ctx, gbest,
+				       pso_settings->dim, &grad_settings);
 
-    // return the mean across the per-target optimization errors
+    // replace current RNN values with trained values
+    [self setFromVector:[GSLVector vectorFromCArray:gbest
+					   withSize:pso_settings->dim]
+	      withGraph:graph
+		forNode:i];
+
+    return solution.error;
+
+}
+
+
+// fit the parameters of node i that correspond to graph
+// (logit least squares)
+// returns the prediction MSE of the node
+- (double) fitNode:(int)i
+     usingDynamics:(Dynamics *)tdyn
+	 withGraph:(Digraph *)graph
+{
+
+    int dim = [[self class] calcDimForNode:i
+				 withGraph:graph];
+    double vec[dim];
+
+    // get the regulators of the target (in increasing order)
+    const cgraph_t *g = [graph compact];
+
+    // set up training context
+    train_ctx_t ctx;
+    init_train_ctx(&ctx, self, tdyn);
+    ctx.target = i;
+    ctx.regs = g->in + g->in_ptr[i];
+    ctx.nregs = CGRAPH_IN_DEGREE(g, i);
+
+    // fit the weights and the bias term
+    fit_logit_ls(&ctx, vec);
+    // no decay (i.e. delta_t / T = 1)
+    if (ctx.decay)
+	vec[ctx.nregs + 1] = ctx.delta_t;
+
+    // replace current RNN values with the fitted values
+    [self setFromVector:[GSLVector vectorFromCArray:vec
+					   withSize:dim]
+	      withGraph:graph
+		forNode:i];
+
+    // the prediction error of the fitted parameters
+    return local_pso_obj_fun(vec, dim, GSL_POSINF, &ctx);
+
+}
+
+
+
+// fit all nodes of the RNN that corresponds to graph
+// returns the mean across the per-target prediction errors
+- (double) fitUsingDynamics:(Dynamics *)tdyn
+		  withGraph:(Digraph *)graph
+{
+
+    int i;
+    GSLVector *errors = [GSLVector vectorWithSize:nodes];
+
+    for (i=0; i<nodes; i++)
+	[errors setValue:[self fitNode:i
+			 usingDynamics:tdyn
+			     withGraph:graph]
+		 atIndex:i];
+
+    // return the mean across the per-target prediction errors
     return [errors mean];
 
 }
@@ -677,42 +1290,42 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 - (Dynamics *)predict:(Dynamics *)adyn {
 
-    // get info about the actual dynamics
-    int tpoints = [adyn tpoints];
-
     // initialize the predicted dynamics
     Dynamics *pdyn = [Dynamics dynamicsWithVars:nodes
-				     andTPoints:tpoints];
+				     andTPoints:[adyn tpoints]];
 
-    int reg, trg, t;
-    double wsum, x;
+    // perform one-step-ahead prediction
+    // for all time points (pdyn's matrix is written in place)
+    if (csr)
+	predict_trajectory_csr([adyn matrix], csr,
+			       [B vec]->data, NULL, 0,
+			       (gsl_matrix *)[pdyn matrix]);
+    else
+	predict_trajectory([adyn matrix], [W matrix],
+			   [B vec]->data, NULL, 0,
+			   (gsl_matrix *)[pdyn matrix]);
 
+    return pdyn;
 
-    // copy first time point from adyn
-    [pdyn replaceRow:0 withRow:0 fromMatrix:adyn];
+}
 
-    // perform one-step-ahead prediction
-    // for all time points
-    for (t=1; t<tpoints; t++)
-	// for each target
-	for (trg=0; trg<nodes; trg++) {
-	    // calculate the cumulative weighted effect 
-	    // of all regulators
-	    wsum = 0;
-	    for (reg=0; reg<nodes; reg++) 
-		// update weighted sum
-		wsum += [W valueAtRow:trg andColumn:reg] * 
-		    [adyn valueOfVar:reg atTPoint:t-1];
 
-	    // calculate x_i(t) of target
-	    x = sigmoid0(wsum + [B valueAtIndex:trg], SIG_MU, SIG_LAMDA);
-	    // add it to the predicted time series
-	    [pdyn setValue:x
-		     ofVar:trg
-		  atTPoint:t];
-	}
 
-    return pdyn;
+// only the active regulators are visited when W is sparse
+- (void) preactivations:(double *)u
+	       ofTarget:(int)trg
+		  given:(Dynamics *)adyn
+{
+
+    if (csr)
+	predict_column([adyn matrix], 
+		       csr->reg + csr->rowptr[trg], csr->w + csr->rowptr[trg],
+		       csr->rowptr[trg+1] - csr->rowptr[trg],
+		       [B valueAtIndex:trg], u);
+    else
+	predict_column([adyn matrix], NULL, 
+		       gsl_matrix_const_ptr([W matrix], trg, 0), nodes,
+		       [B valueAtIndex:trg], u);
 
 }
 
@@ -728,30 +1341,23 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // initialize the predicted dynamics
     Dynamics *pdyn = [adyn copy];
 
-    int reg, t;
-    double wsum, x;
+    int t;
+    double u[tpoints]; // the target's pre-activations
 
 
     // perform one-step-ahead prediction
-    // for all time points
-    for (t=1; t<tpoints; t++) {
-	// for the specified target
-
-	// calculate the cumulative weighted effect 
-	// of all regulators
-	wsum = 0;
-	for (reg=0; reg<nodes; reg++) 
-	    // update weighted sum
-	    wsum += [W valueAtRow:trg andColumn:reg] * 
-		[adyn valueOfVar:reg atTPoint:t-1];
-
-	// calculate x_i(t) of target
-	x = sigmoid0(wsum + [B valueAtIndex:trg], SIG_MU, SIG_LAMDA);
-	// add it to the predicted time series
-	[pdyn setValue:x
+    // for all time points (of the specified target)
+    [self preactivations:u+1
+		ofTarget:trg
+		   given:adyn];
+
+    // calculate x_i(t) of target for all time points
+    act_sigmoid(u + 1, NULL, tpoints - 1);
+    // add them to the predicted time series
+    for (t=1; t<tpoints; t++)
+	[pdyn setValue:u[t]
 		 ofVar:trg
 	      atTPoint:t];
-    }
 
 
     return [pdyn autorelease];
@@ -862,7 +1468,7 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 	     withGraph:(Digraph *) graph
 {
 
-    return [graph inDegreeOfNode:[NSNumber numberWithInt:node]] + 2;
+    return CGRAPH_IN_DEGREE([graph compact], node) + 2;
 
 }
 
@@ -959,6 +1565,14 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 
 
+- (double) deltaT {
+
+    return delta_t;
+
+}
+
+
+
 - (void) setDeltaT:(double)val {
 
     delta_t = val;
@@ -970,28 +1584,17 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 // setters
 - (void) setFromVector:(GSLVector *)vec {
 
-    int i, j, vec_idx;
+    int i, vec_idx;
     // figure out number of nodes
     //int n = [DRNN calcNodesForDim:[vec count]];
     // make sure this is correct
     //NSAssert(n == nodes, @"Dimensionality mismatch!!");
 
-    // initialize vec's index
-    vec_idx = 0;
-
-    // read in weight matrix
-    for (i=0; i<nodes; i++)
-	for (j=0; j<nodes; j++) 
-	    // extract weight value and increment vec_idx
-	    [W setValue:[vec valueAtIndex:vec_idx++]
-		  atRow:i
-	      andColumn:j];
+    // read in weight matrix and bias vector
+    [super setFromVector:vec];
 
-    // read in bias vector
-    for (i=0; i<nodes; i++)
-	// extract bias term value and increment vec_idx
-	[B setValue:[vec valueAtIndex:vec_idx++]
-	    atIndex:i];
+    // skip weights and biases
+    vec_idx = nodes * (nodes + 1);
 
     // read in time constants
     for (i=0; i<nodes; i++)
@@ -1014,31 +1617,13 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // make sure this is correct
     //NSAssert(n == nodes, @"Dimensionality mismatch!!");
 
-    // reset all parameter values
-    [self reset];
-
-    // initialize index to vec
-    vec_idx = 0;
-
-    // get graph edges
-    NSArray *edges = [graph edges];
-    int n_e = [edges count];
-    Edge *e;
-
-    // read in weight values (corresponding to graph edges)
-    for (i=0; i<n_e; i++) {
-	// get the edge
-	e = [edges objectAtIndex:i];
-	[W setValue:[vec valueAtIndex:vec_idx++]
-	      atRow:[[e to] intValue] // rows are targets
-	  andColumn:[[e from] intValue]]; // cols are regulators
-    }
+    // read in weight values (corresponding to graph edges) 
+    // and bias vector
+    [super setFromVector:vec
+	       withGraph:graph];
 
-    // read in bias vector
-    for (i=0; i<nodes; i++)
-	// extract bias term value and increment vec_idx
-	[B setValue:[vec valueAtIndex:vec_idx++]
-	    atIndex:i];
+    // skip weights and biases
+    vec_idx = csr->nnz + nodes;
 
     // read in time constants vector
     for (i=0; i<nodes; i++)
@@ -1056,27 +1641,31 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 	       forNode:(int)row
 {
 
-    int i, vec_idx;
+    // read in weights and bias term value
+    [super setFromVector:vec
+		 forNode:row];
 
-    // reset RNN values
-    //[self reset]; --> NOT NEEDED HERE
+    // read in time constant value
+    [T setValue:[vec valueAtIndex:nodes+1]
+	atIndex:row];
 
-    // initialize vec's index
-    vec_idx = 0;
+}
 
-    // read in weight matrix
-    for (i=0; i<nodes; i++) 
-	// extract weight value and increment vec_idx
-	[W setValue:[vec valueAtIndex:vec_idx++]
-	      atRow:row
-	  andColumn:i];
 
-    // read in bias term value
-    [B setValue:[vec valueAtIndex:vec_idx++]
-	atIndex:row];
+
+
+- (void) setFromVector:(GSLVector *)vec
+	     withGraph:(Digraph *)graph
+	       forNode:(int)row;
+{
+
+    // read in weights (of the node's regulators) and bias term value
+    [super setFromVector:vec
+	       withGraph:graph
+		 forNode:row];
 
     // read in time constant value
-    [T setValue:[vec valueAtIndex:vec_idx]
+    [T setValue:[vec valueAtIndex:csr->rowptr[row+1]-csr->rowptr[row]+1]
 	atIndex:row];
 
 }
@@ -1084,36 +1673,40 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 
 
-- (void) setFromVector:(GSLVector *)vec
-	     withGraph:(Digraph *)graph
-	       forNode:(int)row;
+
+
+// getters
+- (GSLVector *) vectorForNode:(int)row
+	       withRegulators:(NSArray *)regs
 {
 
-    int vec_idx;
+    // weights and bias term
+    GSLVector *vec = [super vectorForNode:row
+			   withRegulators:regs];
 
-    // reset the node's parameter values 
-    [self resetNode:row];
+    // the time constant
+    [vec setValue:[T valueAtIndex:row]
+	  atIndex:[regs count] + 1];
 
-    // initialize index to vec
-    vec_idx = 0;
+    return vec;
 
-    // get graph edges (array of NSNumbers)
-    NSEnumerator *regs = [[graph predecessorsOfNode:[NSNumber numberWithInt:row]]
-			     objectEnumerator];
-    NSNumber *reg;
-    while ((reg = [regs nextObject]))
-	[W setValue:[vec valueAtIndex:vec_idx++]
-	      atRow:row
-	  andColumn:[reg intValue]];
-    
+}
 
-    // read in bias term value
-    [B setValue:[vec valueAtIndex:vec_idx++]
-	atIndex:row];
 
-    // read in time constant value
-    [T setValue:[vec valueAtIndex:vec_idx]
-	atIndex:row];
+
+- (GSLVector *) vectorWithGraph:(Digraph *)graph {
+
+    int i;
+    // weights and bias vector
+    GSLVector *vec = [super vectorWithGraph:graph];
+    int vec_idx = [graph countEdges] + nodes;
+
+    // the time constants
+    for (i=0; i<nodes; i++)
+	[vec setValue:[T valueAtIndex:i]
+	      atIndex:vec_idx++];
+
+    return vec;
 
 }
 
@@ -1166,41 +1759,20 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
 
 - (Dynamics *)predict:(Dynamics *)adyn {
 
-    // get info about the actual dynamics
-    int tpoints = [adyn tpoints];
-
     // initialize the predicted dynamics
     Dynamics *pdyn = [Dynamics dynamicsWithVars:nodes
-				     andTPoints:tpoints];
-
-    int reg, trg, t;
-    double wsum, x;
-
-
-    // copy first time point from adyn
-    [pdyn replaceRow:0 withRow:0 fromMatrix:adyn];
+				     andTPoints:[adyn tpoints]];
 
     // perform one-step-ahead prediction
-    // for all time points
-    for (t=1; t<tpoints; t++)
-	// for each target
-	for (trg=0; trg<nodes; trg++) {
-	    // calculate the cumulative weighted effect 
-	    // of all regulators
-	    wsum = 0;
-	    for (reg=0; reg<nodes; reg++) 
-		// update weighted sum
-		wsum += [W valueAtRow:trg andColumn:reg] * 
-		    [adyn valueOfVar:reg atTPoint:t-1];
-
-	    // calculate x_i(t) of target
-	    x = (delta_t / [T valueAtIndex:trg]) * sigmoid0(wsum+[B valueAtIndex:trg], SIG_MU, SIG_LAMDA) +
-		(1 - (delta_t / [T valueAtIndex:trg])) * [adyn valueOfVar:trg atTPoint:t-1];
-	    // add entry to the predicted time series
-	    [pdyn setValue:x
-		     ofVar:trg
-		  atTPoint:t];
-	}
+    // for all time points (pdyn's matrix is written in place)
+    if (csr)
+	predict_trajectory_csr([adyn matrix], csr,
+			       [B vec]->data, [T vec]->data, delta_t,
+			       (gsl_matrix *)[pdyn matrix]);
+    else
+	predict_trajectory([adyn matrix], [W matrix],
+			   [B vec]->data, [T vec]->data, delta_t,
+			   (gsl_matrix *)[pdyn matrix]);
 
     return pdyn;
 
@@ -1218,25 +1790,23 @@ double local_pso_obj_fun_with_graph(double *vec, size_t dim, void *params) {
     // initialize the predicted dynamics
     Dynamics *pdyn = [adyn copy];
 
-    int reg, t;
-    double wsum, x;
+    int t;
+    double x;
+    double a = delta_t / [T valueAtIndex:trg];
+    double u[tpoints]; // the target's pre-activations
 
 
     // perform one-step-ahead prediction
-    // for all time points
-    for (t=1; t<tpoints; t++) {
-	// for specified target ::
-	// calculate the cumulative weighted effect 
-	// of all regulators
-	wsum = 0;
-	for (reg=0; reg<nodes; reg++) 
-	    // update weighted sum
-	    wsum += [W valueAtRow:trg andColumn:reg] * 
-		[adyn valueOfVar:reg atTPoint:t-1];
+    // for all time points (of the specified target)
+    [self preactivations:u+1
+		ofTarget:trg
+		   given:adyn];
 
+    // calculate the sigmoid outputs for all time points
+    act_sigmoid(u + 1, NULL, tpoints - 1);
+    for (t=1; t<tpoints; t++) {
 	// calculate x_i(t) of target
-	x = (delta_t / [T valueAtIndex:trg]) * sigmoid0(wsum+[B valueAtIndex:trg], SIG_MU, SIG_LAMDA) +
-	    (1 - (delta_t / [T valueAtIndex:trg])) * [adyn valueOfVar:trg atTPoint:t-1];
+	x = a * u[t] + (1 - a) * [adyn valueOfVar:trg atTPoint:t-1];
 	// add entry to the predicted time series
 	[pdyn setValue:x
 		 ofVar:trg
@@ -13,7 +13,10 @@
 
 }
 
-+ (id) generateWith:(GSLMatrix *)phero;
+// generate and evaluate the graph of an ant (of step)
++ (id) generateWith:(GSLMatrix *)phero
+	    forStep:(int)step
+	     andAnt:(int)ant;
 
 - (id) init;
 
@@ -42,3 +45,7 @@
 
 // the network inference function
 Solution *netinf(Dynamics *lamda);
+
+// the last step at which gbest improved and its error (see --stop_stall)
+void get_stall_state(int *step, double *error);
+void set_stall_state(int step, double error);
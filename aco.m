@@ -1,25 +1,66 @@
 #import "aco.h"
 #import "graphs.h"
 #import "params.h"
+#import "workers.h"
+#import "checkpoint.h"
+#import "trace.h"
 
 #import "common.h"
 
 #import <math.h>
+#import <stdint.h> // for uint64_t
 
 
 #define ERR_FUN(X) ((X)>5 ? 5 : log10((X)) / (log10((X)) - 1))
 
+
+// the number of ants of the current step whose graph was a duplicate
+// (i.e. was not evaluated; see settings.gcache)
+static int duplicates = 0;
+
+
+
+// evaluate the graph of an ant (and trace it)
+static GSLVector *evaluate_ant(Digraph *g, int step, int ant) {
+
+  long evals = 0;
+  NSDate *start = [NSDate date];
+  GSLVector *v = evaluate_graph(g, &evals);
+
+  if (settings.trace)
+    trace_ant(step, ant, g, v, evals, -[start timeIntervalSinceNow], 0);
+
+  return v;
+
+}
+
 //***********************************************************************
 //***********************************************************************
 @implementation Solution
 
 
-+ (id) generateWith:(GSLMatrix *)phero {
++ (id) generateWith:(GSLMatrix *)phero
+	    forStep:(int)step
+	     andAnt:(int)ant
+{
 
   // generate graph
   Digraph *g = generate_graph(phero);
-  // evaluate graph
-  GSLVector *v = evaluate_graph(g);
+  // has it been evaluated already??
+  NSData *key = settings.gcache ? [GraphCache keyForGraph:g] : nil;
+  GSLVector *v = key ? [settings.gcache errorsForKey:key] : nil;
+
+  if (v) {
+    duplicates += 1;
+    if (settings.trace)
+      trace_ant(step, ant, g, v, 0, 0, TRACE_DUPLICATE);
+  } else {
+    // evaluate graph
+    v = evaluate_ant(g, step, ant);
+    if (key)
+      [settings.gcache setErrors:v
+			  forKey:key];
+  }
 
   // return Solution object
   return [[[Solution alloc] initWithGraph:g
@@ -94,9 +135,9 @@
 
 - (void) updateWith:(Solution *)other {
 
-  int reg, trg;
+  const cgraph_t *g = [[other graph] compact];
+  int k, trg;
   NSNumber *target;
-  NSArray *regs;
 
   for (trg=0; trg<settings.nodes; trg++) 
     if ([[other errors] valueAtIndex:trg] < [errors valueAtIndex:trg]) {
@@ -104,11 +145,9 @@
       target = [NSNumber numberWithInt:trg];
       // remove all incoming edges of target
       [graph removeAllInEdgesOfNode:target];
-      // get regulators from other
-      regs = [[other graph] predecessorsOfNode:target];
-      // add (reg,trg) edges to [self graph]
-      for (reg=0; reg<[regs count]; reg++)
-	[graph addEdgeFrom:[regs objectAtIndex:reg]
+      // add the (reg,trg) edges of other to [self graph]
+      for (k=g->in_ptr[trg]; k<g->in_ptr[trg+1]; k++)
+	[graph addEdgeFrom:[NSNumber numberWithInt:g->in[k]]
 			To:target];
       // update error for target
       [errors setValue:[[other errors] valueAtIndex:trg]
@@ -180,26 +219,125 @@ void update_lamda(Dynamics *lamda, GSLMatrix *phero, int step) {
 }
 
 
-void update_phero(GSLMatrix *phero, Solution *sol) {
+// the mean (over the targets) entropy of the edge probabilities of
+// phero (see phero_model()), normalized to [0,1]
+double phero_entropy(GSLMatrix *phero) {
 
-  NSArray *edges = [[sol graph] edges];
-  Edge *e;
-  int i;
+  const gsl_matrix *m = [phero matrix];
+  int n = m->size1, reg, trg;
+  double sum, p, h, total = 0;
+
+  if (n < 2)
+    return 0;
+
+  for (trg=0; trg<n; trg++) {
+    sum = 0;
+    for (reg=0; reg<n; reg++)
+      sum += gsl_matrix_get(m, reg, trg);
+    h = 0;
+    for (reg=0; reg<n; reg++) {
+      p = sum > 0 ? gsl_matrix_get(m, reg, trg) / sum : 0;
+      if (p > 0)
+	h -= p * log(p);
+    }
+    total += h / log(n);
+  }
+
+  return total / n;
+
+}
+
+
+
+// the last step at which gbest improved (see converged())
+static int gbest_step = -1;
+static double gbest_error = DBL_MAX;
+
+
+// the state of the gbest stall criterion (saved by the checkpoints)
+void get_stall_state(int *step, double *error) {
+
+  *step = gbest_step;
+  *error = gbest_error;
+
+}
+
+
+
+void set_stall_state(int step, double error) {
+
+  gbest_step = step;
+  gbest_error = error;
+
+}
+
+
+// check the stop criteria after step; sets settings.stop_reason
+// and settings.stop_step and returns YES if the ACO should stop
+BOOL converged(Dynamics *lamda, GSLMatrix *phero, Solution *gbest, int step) {
+
+  double err = [[gbest errors] sum];
+  int t, trg;
+  BOOL stable;
+
+  // has gbest improved??
+  if (err < gbest_error || gbest_step < 0) {
+    gbest_error = err;
+    gbest_step = step;
+  }
+
+  settings.stop_step = step;
+
+  // the lamda factors of the last stop_lamda steps equal those of step
+  if (settings.stop_lamda > 0 && step >= settings.stop_lamda) {
+    stable = YES;
+    for (t=step-settings.stop_lamda; stable && t<step; t++)
+      for (trg=0; stable && trg<settings.nodes; trg++)
+	stable = [lamda valueOfVar:trg atTPoint:t] ==
+	  [lamda valueOfVar:trg atTPoint:step];
+    if (stable) {
+      settings.stop_reason = STOP_LAMDA_STABLE;
+      printf("Lamda factors unchanged for %d steps\n", settings.stop_lamda);
+      return YES;
+    }
+  }
+
+  if (settings.stop_stall > 0 && step - gbest_step >= settings.stop_stall) {
+    settings.stop_reason = STOP_GBEST_STALL;
+    printf("No gbest improvement for %d steps\n", settings.stop_stall);
+    return YES;
+  }
+
+  if (settings.stop_entropy > 0 && phero_entropy(phero) < settings.stop_entropy) {
+    settings.stop_reason = STOP_LOW_ENTROPY;
+    printf("Pheromone entropy below %g\n", settings.stop_entropy);
+    return YES;
+  }
+
+  return NO;
+
+}
+
+
+
+// deposit pheromone on the edges of sol (weight : the fraction
+// of a full deposit)
+void update_phero(GSLMatrix *phero, Solution *sol, double weight) {
+
+  const cgraph_t *g = [[sol graph] compact];
+  int k;
     
-  for (i=0; i<[edges count]; i++) {
-    // get edge
-    e = [edges objectAtIndex:i];
+  for (k=0; k<g->edges; k++)
     // update corresponding pheromone matrix entry
     // with target error
-    [phero addValue:ERR_FUN([[sol errors] valueAtIndex:[[e to] intValue]])
-	      atRow:[[e from] intValue]
-	  andColumn:[[e to] intValue]];
-  }
+    [phero addValue:weight * ERR_FUN([[sol errors] valueAtIndex:g->trg[k]])
+	      atRow:g->in[k]
+	  andColumn:g->trg[k]];
 }
 
 
 
-void evaporate_phero(GSLMatrix *phero) {
+void evaporate_phero(GSLMatrix *phero, double rho) {
 
   int i,j;
   int rows = [phero rows];
@@ -210,7 +348,7 @@ void evaporate_phero(GSLMatrix *phero) {
     for (j=0; j<cols; j++) {
       val = [phero valueAtRow:i
 		    andColumn:j];
-      [phero addValue:-settings.aco_rho * val
+      [phero addValue:-rho * val
 		atRow:i
 	    andColumn:j];
     }
@@ -218,6 +356,652 @@ void evaporate_phero(GSLMatrix *phero) {
 }
 
 
+//***********************************************************************
+//                  PARALLEL EVALUATION OF THE ANTS
+//***********************************************************************
+
+// the seed of the RNG stream of an ant, derived from settings.seed
+// (splitmix64 of the seed and the ant's position in the simulation)
+unsigned long ant_seed(int step, int ant) {
+
+  uint64_t z = (uint64_t)settings.seed + 
+    0x9E3779B97F4A7C15ULL * ((uint64_t)step * settings.aco_ants + ant + 1);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return (unsigned long)(z ^ (z >> 31));
+
+}
+
+
+
+// find the ants of a step whose graph needs no evaluation
+// ** errors[ant] : the cached errors of the graph (nil if unknown)
+// ** dup[ant] : the first ant of the step with the same graph (ant
+//    for the ants to evaluate, -1 for the cached graphs)
+// ** todo : the ants to evaluate (in ant order)
+// returns the number of ants to evaluate
+static int find_duplicates(Digraph **graphs, NSData **keys, GSLVector **errors,
+			   int *dup, int *todo, int ants)
+{
+
+  NSMutableDictionary *first = [NSMutableDictionary dictionary];
+  NSNumber *n;
+  int ant, count = 0;
+
+  for (ant=0; ant<ants; ant++) {
+    dup[ant] = ant;
+    errors[ant] = nil;
+    keys[ant] = nil;
+    if (settings.gcache) {
+      keys[ant] = [GraphCache keyForGraph:graphs[ant]];
+      // known from a previous step??
+      errors[ant] = [settings.gcache errorsForKey:keys[ant]];
+      // or generated by an earlier ant of the step??
+      if (!errors[ant] && (n = [first objectForKey:keys[ant]]))
+	dup[ant] = [n intValue];
+      else if (!errors[ant])
+	[first setObject:[NSNumber numberWithInt:ant]
+		  forKey:keys[ant]];
+    }
+    if (errors[ant])
+      dup[ant] = -1;
+    if (dup[ant] != ant)
+      duplicates += 1;
+    else
+      todo[count++] = ant;
+  }
+
+  return count;
+
+}
+
+
+
+// the errors of the duplicate ants of a step (after the evaluation
+// of the rest) and the cache entries of the evaluated ones
+static void complete_duplicates(Digraph **graphs, NSData **keys,
+				GSLVector **errors, int *dup,
+				int step, int ants)
+{
+
+  int ant;
+
+  for (ant=0; ant<ants; ant++)
+    if (dup[ant] == ant) {
+      if (keys[ant])
+	[settings.gcache setErrors:errors[ant]
+			    forKey:keys[ant]];
+    } else {
+      if (dup[ant] >= 0)
+	errors[ant] = errors[dup[ant]];
+      if (settings.trace)
+	trace_ant(step, ant, graphs[ant], errors[ant], 0, 0, TRACE_DUPLICATE);
+    }
+
+}
+
+
+
+// a worker thread :: evaluates the ants todo[first], todo[first+stride],
+// ... of a step (each ant with its own RNG stream) and records their
+// errors and their updates of the shared state
+@interface AntWorker : NSObject {
+
+  int step;
+  Digraph **graphs; // the graph of each ant
+  RNG **rngs; // the RNG stream of each ant
+  int *todo; // the ants to evaluate
+  int count; // the number of ants to evaluate
+  int first;
+  int stride;
+  GSLVector **errors; // the errors of each ant
+  EvalUpdates **updates; // the updates of each ant
+  NSConditionLock *done; // the number of finished workers
+
+}
+
+- (id) initWithStep:(int)s
+	     graphs:(Digraph **)gs
+	       rngs:(RNG **)rs
+	       todo:(int *)t
+	      count:(int)c
+	      first:(int)f
+	     stride:(int)n
+	     errors:(GSLVector **)errs
+	    updates:(EvalUpdates **)upds
+	       done:(NSConditionLock *)d;
+
+- (void) run:(id)arg;
+
+@end
+
+
+
+@implementation AntWorker
+
+- (id) initWithStep:(int)s
+	     graphs:(Digraph **)gs
+	       rngs:(RNG **)rs
+	       todo:(int *)t
+	      count:(int)c
+	      first:(int)f
+	     stride:(int)n
+	     errors:(GSLVector **)errs
+	    updates:(EvalUpdates **)upds
+	       done:(NSConditionLock *)d
+{
+
+  self = [super init];
+  if (!self)
+    return nil;
+
+  step = s;
+  graphs = gs;
+  rngs = rs;
+  todo = t;
+  count = c;
+  first = f;
+  stride = n;
+  errors = errs;
+  updates = upds;
+  done = [d retain];
+
+  return self;
+
+}
+
+
+- (void) dealloc {
+
+  [done release];
+  [super dealloc];
+
+}
+
+
+- (void) run:(id)arg {
+
+  int i, ant;
+  NSAutoreleasePool *pool;
+  // the pool of the thread (see the pool of each ant below)
+  NSAutoreleasePool *tpool = [[NSAutoreleasePool alloc] init];
+
+  for (i=first; i<count; i+=stride) {
+    ant = todo[i];
+    // allocate new pool
+    pool = [[NSAutoreleasePool alloc] init];
+    // the ant's RNG stream and updates
+    updates[ant] = [[EvalUpdates alloc] init];
+    set_thread_rng(rngs[ant]);
+    set_thread_updates(updates[ant]);
+    // evaluate the ant's graph
+    errors[ant] = [evaluate_ant(graphs[ant], step, ant) retain];
+    set_thread_updates(nil);
+    set_thread_rng(nil);
+    // empty pool
+    [pool release];
+  }
+
+  [tpool release];
+
+  // one more worker finished
+  [done lock];
+  [done unlockWithCondition:[done condition] + 1];
+
+}
+
+@end
+
+
+
+// evaluate the ants of a step on settings.ant_threads threads and
+// update lbest with their solutions (in ant order)
+// the graphs are generated (and the duplicates are found) on the
+// calling thread; each ant's RNG stream continues with its evaluation
+// the ants read the shared state (cache, prior) as it was at the
+// beginning of the step; their updates are applied in ant order,
+// so the result depends only on the seed (and not on the threads)
+void run_ants(GSLMatrix *phero, int step, Solution *lbest) {
+
+  int ants = settings.aco_ants;
+  Digraph *graphs[ants];
+  RNG *rngs[ants];
+  NSData *keys[ants];
+  GSLVector *errors[ants];
+  EvalUpdates *updates[ants];
+  int dup[ants], todo[ants], count;
+  int nthreads;
+  NSConditionLock *done = [[NSConditionLock alloc] initWithCondition:0];
+  AntWorker *worker;
+  int i, ant;
+
+  // generate the graphs (with the ants' RNG streams)
+  for (ant=0; ant<ants; ant++) {
+    rngs[ant] = [[RNG alloc] initWithSeed:ant_seed(step, ant)];
+    set_thread_rng(rngs[ant]);
+    graphs[ant] = generate_graph(phero);
+    set_thread_rng(nil);
+    updates[ant] = nil;
+  }
+  count = find_duplicates(graphs, keys, errors, dup, todo, ants);
+  nthreads = settings.ant_threads < count ? settings.ant_threads : count;
+
+  // start from the last worker; the calling thread is the first one
+  for (i=nthreads-1; i>=0; i--) {
+    worker = [[AntWorker alloc] initWithStep:step
+				      graphs:graphs
+					rngs:rngs
+					todo:todo
+				       count:count
+				       first:i
+				      stride:nthreads
+				      errors:errors
+				     updates:updates
+					done:done];
+    if (i > 0)
+      [NSThread detachNewThreadSelector:@selector(run:)
+			       toTarget:worker
+			     withObject:nil];
+    else
+      [worker run:nil];
+    [worker release];
+  }
+
+  // wait for all workers
+  [done lockWhenCondition:nthreads];
+  [done unlock];
+  [done release];
+
+  // the evaluated ants hold their errors (retained)
+  for (i=0; i<count; i++)
+    [errors[todo[i]] autorelease];
+  complete_duplicates(graphs, keys, errors, dup, step, ants);
+
+  // apply the updates and update lbest in ant order
+  for (ant=0; ant<ants; ant++) {
+    [updates[ant] apply];
+    [lbest updateWith:[[[Solution alloc] initWithGraph:graphs[ant]
+					     andErrors:errors[ant]]
+			autorelease]];
+    [updates[ant] release];
+    [rngs[ant] release];
+  }
+
+}
+
+
+
+// evaluate the ants of a step on the worker processes and update
+// lbest with their solutions (in ant order)
+// the graphs are generated (and the duplicates are found) locally;
+// each worker process keeps its own cache and prior
+void run_ants_remote(GSLMatrix *phero, int step, Solution *lbest) {
+
+  int ants = settings.aco_ants;
+  Digraph *graphs[ants], *unique[ants];
+  NSData *keys[ants];
+  GSLVector *errors[ants], *results[ants];
+  unsigned long seeds[ants];
+  int dup[ants], todo[ants], count;
+  int i, ant;
+
+  for (ant=0; ant<ants; ant++)
+    graphs[ant] = generate_graph(phero);
+  count = find_duplicates(graphs, keys, errors, dup, todo, ants);
+
+  // send only the graphs that need an evaluation
+  for (i=0; i<count; i++) {
+    unique[i] = graphs[todo[i]];
+    seeds[i] = ant_seed(step, todo[i]);
+  }
+
+  if (workers_evaluate(unique, seeds, results, count)) {
+    fprintf(stderr, "Graph evaluation on the workers failed\nAborting.\n");
+    exit(1);
+  }
+
+  // (the workers do not report their evaluations and times)
+  for (i=0; i<count; i++) {
+    errors[todo[i]] = results[i];
+    if (settings.trace)
+      trace_ant(step, todo[i], graphs[todo[i]], results[i], -1, -1, 0);
+  }
+  complete_duplicates(graphs, keys, errors, dup, step, ants);
+
+  for (ant=0; ant<ants; ant++)
+    [lbest updateWith:[[[Solution alloc] initWithGraph:graphs[ant]
+					     andErrors:errors[ant]]
+			autorelease]];
+
+}
+
+
+
+//***********************************************************************
+//                  ASYNCHRONOUS (STEADY-STATE) ACO
+//***********************************************************************
+
+// every evaluated ant updates the pheromone matrix (and gbest) at once
+// and every new ant is generated from the latest pheromone matrix, so
+// that no ant waits for the others to finish
+// aco_ants evaluated ants count as one step :: each ant deposits
+// 1/aco_ants of the deposits of a step and evaporates the pheromone
+// at the rate that compounds to aco_rho over aco_ants ants
+// (the result depends on the order in which the ants finish)
+@interface AsyncACO : NSObject {
+
+  GSLMatrix *phero; // the pheromone matrix
+  Solution *gbest; // the global best solution
+  Dynamics *lamda; // the lamda factors (one per step)
+  NSLock *lock; // guards all of the above and the counters
+  NSConditionLock *done; // the number of finished threads
+  int issued; // the number of generated ants
+  int completed; // the number of evaluated ants
+  int total; // the number of ants of the simulation
+  double rho; // the evaporation rate per evaluated ant
+
+}
+
+- (id) initWithPhero:(GSLMatrix *)p
+	       gbest:(Solution *)g
+	       lamda:(Dynamics *)l;
+
+- (void) dealloc;
+
+- (Digraph *) nextGraph:(RNG **)rng
+		    ant:(int *)index;
+
+- (void) completeGraph:(Digraph *)g
+	    withErrors:(GSLVector *)v
+	       updates:(EvalUpdates *)u;
+
+- (void) run:(id)arg;
+
+- (void) runWithThreads:(int)n;
+
+- (BOOL) submitTo:(int)w
+	   graphs:(Digraph **)graphs
+	     ants:(int *)ants;
+
+- (void) runOnWorkers;
+
+@end
+
+
+
+@implementation AsyncACO
+
+- (id) initWithPhero:(GSLMatrix *)p
+	       gbest:(Solution *)g
+	       lamda:(Dynamics *)l
+{
+
+  self = [super init];
+  if (!self)
+    return nil;
+
+  phero = [p retain];
+  gbest = [g retain];
+  lamda = [l retain];
+  lock = [[NSLock alloc] init];
+  done = [[NSConditionLock alloc] initWithCondition:0];
+  issued = 0;
+  completed = 0;
+  total = settings.aco_steps * settings.aco_ants;
+  rho = 1 - pow(1 - settings.aco_rho, 1. / settings.aco_ants);
+
+  return self;
+
+}
+
+
+- (void) dealloc {
+
+  [phero release];
+  [gbest release];
+  [lamda release];
+  [lock release];
+  [done release];
+  [super dealloc];
+
+}
+
+
+// generate the next ant's graph from the latest pheromone matrix
+// (nil when all ants have been generated); rng receives the ant's
+// RNG stream (retained), which continues with the evaluation, and
+// index the position of the ant in the simulation
+- (Digraph *) nextGraph:(RNG **)rng
+		    ant:(int *)index
+{
+
+  Digraph *g = nil;
+
+  [lock lock];
+  if (issued < total) {
+    *index = issued;
+    *rng = [[RNG alloc] initWithSeed:ant_seed(issued / settings.aco_ants,
+					      issued % settings.aco_ants)];
+    set_thread_rng(*rng);
+    prepare_graphs(phero);
+    g = generate_graph(phero);
+    set_thread_rng(nil);
+    issued += 1;
+  }
+  [lock unlock];
+
+  return g;
+
+}
+
+
+// apply the updates of an evaluated ant and update the pheromones
+- (void) completeGraph:(Digraph *)g
+	    withErrors:(GSLVector *)v
+	       updates:(EvalUpdates *)u
+{
+
+  Solution *solution = [[Solution alloc] initWithGraph:g
+					     andErrors:v];
+
+  [lock lock];
+  [u apply];
+  // update gbest and the pheromone matrix
+  [gbest updateWith:solution];
+  update_phero(phero, solution, 1. / settings.aco_ants);
+  update_phero(phero, gbest, 1. / settings.aco_ants);
+  evaporate_phero(phero, rho);
+  completed += 1;
+  // one more step??
+  if (completed % settings.aco_ants == 0 &&
+      settings.stop_reason == STOP_NONE) {
+    printf("Step %d\n", completed / settings.aco_ants - 1);
+    if (settings.gcache)
+      printf("Duplicate ants : %d/%d\n", duplicates, settings.aco_ants);
+    duplicates = 0;
+    update_lamda(lamda, phero, completed / settings.aco_ants - 1);
+    if (settings.trace)
+      trace_phero(completed / settings.aco_ants - 1, phero);
+    // stop generating ants (the running ones still finish)
+    if (converged(lamda, phero, gbest, completed / settings.aco_ants - 1))
+      issued = total;
+  }
+  [lock unlock];
+
+  [solution release];
+
+}
+
+
+// a thread :: evaluates ants until all ants have been generated
+- (void) run:(id)arg {
+
+  Digraph *g;
+  GSLVector *v;
+  NSData *key;
+  RNG *rng;
+  EvalUpdates *updates = nil;
+  int index, step, ant;
+  NSAutoreleasePool *pool;
+  // the pool of the thread (see the pool of each ant below)
+  NSAutoreleasePool *tpool = [[NSAutoreleasePool alloc] init];
+
+  while (1) {
+    // allocate new pool
+    pool = [[NSAutoreleasePool alloc] init];
+    g = [self nextGraph:&rng
+		    ant:&index];
+    if (!g) {
+      [pool release];
+      break;
+    }
+    step = index / settings.aco_ants;
+    ant = index % settings.aco_ants;
+    key = settings.gcache ? [GraphCache keyForGraph:g] : nil;
+    v = key ? [settings.gcache errorsForKey:key] : nil;
+    if (v) {
+      // a duplicate :: no evaluation (and no updates)
+      [lock lock];
+      duplicates += 1;
+      [lock unlock];
+      if (settings.trace)
+	trace_ant(step, ant, g, v, 0, 0, TRACE_DUPLICATE);
+    } else {
+      // evaluate it with the ant's RNG stream and updates
+      updates = [[EvalUpdates alloc] init];
+      set_thread_rng(rng);
+      set_thread_updates(updates);
+      v = evaluate_ant(g, step, ant);
+      set_thread_updates(nil);
+      set_thread_rng(nil);
+      if (key)
+	[settings.gcache setErrors:v
+			    forKey:key];
+    }
+    [self completeGraph:g
+	     withErrors:v
+		updates:updates];
+    [updates release];
+    updates = nil;
+    [rng release];
+    // empty pool
+    [pool release];
+  }
+
+  [tpool release];
+
+  // one more thread finished
+  [done lock];
+  [done unlockWithCondition:[done condition] + 1];
+
+}
+
+
+- (void) runWithThreads:(int)n {
+
+  int i;
+
+  // the calling thread is the first one
+  for (i=1; i<n; i++)
+    [NSThread detachNewThreadSelector:@selector(run:)
+			     toTarget:self
+			   withObject:nil];
+  [self run:nil];
+
+  // wait for all threads
+  [done lockWhenCondition:(n > 1 ? n : 1)];
+  [done unlock];
+
+}
+
+
+// generate the next graph (ant) and send it to worker w (the duplicate
+// graphs are completed at once); NO when all ants have been generated
+- (BOOL) submitTo:(int)w
+	   graphs:(Digraph **)graphs
+	     ants:(int *)ants
+{
+
+  RNG *rng;
+  GSLVector *v;
+
+  while (1) {
+    graphs[w] = [[self nextGraph:&rng
+			     ant:&ants[w]] retain];
+    if (!graphs[w])
+      return NO;
+    v = settings.gcache ? [settings.gcache errorsForKey:[GraphCache keyForGraph:graphs[w]]] : nil;
+    if (!v)
+      break;
+    duplicates += 1;
+    if (settings.trace)
+      trace_ant(ants[w] / settings.aco_ants, ants[w] % settings.aco_ants,
+		graphs[w], v, 0, 0, TRACE_DUPLICATE);
+    [self completeGraph:graphs[w]
+	     withErrors:v
+		updates:nil];
+    [graphs[w] release];
+    [rng release];
+  }
+
+  if (workers_submit(w, graphs[w], [rng seed])) {
+    fprintf(stderr, "Graph evaluation on the workers failed\nAborting.\n");
+    exit(1);
+  }
+  [rng release];
+
+  return YES;
+
+}
+
+
+- (void) runOnWorkers {
+
+  int w, n = workers_count(), npending = 0;
+  Digraph *graphs[n];
+  int ants[n];
+  GSLVector *v;
+  NSAutoreleasePool *pool;
+
+  // one graph per worker at a time
+  for (w=0; w<n; w++)
+    if ([self submitTo:w graphs:graphs ants:ants])
+      npending += 1;
+
+  while (npending > 0) {
+    // allocate new pool
+    pool = [[NSAutoreleasePool alloc] init];
+    // the first worker that finishes gets the next graph
+    w = workers_receive(&v);
+    if (w < 0) {
+      fprintf(stderr, "Graph evaluation on the workers failed\nAborting.\n");
+      exit(1);
+    }
+    if (settings.gcache)
+      [settings.gcache setErrors:v
+			  forKey:[GraphCache keyForGraph:graphs[w]]];
+    // (the workers do not report their evaluations and times)
+    if (settings.trace)
+      trace_ant(ants[w] / settings.aco_ants, ants[w] % settings.aco_ants,
+		graphs[w], v, -1, -1, 0);
+    [self completeGraph:graphs[w]
+	     withErrors:v
+		updates:nil];
+    [graphs[w] release];
+    npending -= 1;
+    if ([self submitTo:w graphs:graphs ants:ants])
+      npending += 1;
+    // empty pool
+    [pool release];
+  }
+
+}
+
+@end
+
+
+
 Solution *netinf(Dynamics *lamda) {
 
   // initialize pheromone matrix
@@ -235,46 +1019,131 @@ Solution *netinf(Dynamics *lamda) {
   NSAutoreleasePool *pool;
   // mark starting time
   settings.start = [[NSDate alloc] init];
-  int step, ant;
+  int step, ant, first = 0;
+  BOOL stop;
 
-  printf("ACO steps :\n");
+  // the state of the worker processes is not saved
+  if (settings.resume && workers_count() > 0) {
+    fprintf(stderr, "Checkpoints are not supported by the worker processes\nAborting.\n");
+    exit(1);
+  }
+  if (settings.checkpoint > 0 && workers_count() > 0)
+    printf("Checkpoints are not supported by the worker processes\n");
+
+  // continue from the last checkpoint??
+  if (settings.resume && !settings.aco_async) {
+    first = checkpoint_load(phero, gbest, lamda);
+    if (first < 0) {
+      fprintf(stderr, "Error loading the checkpoint\nAborting.\n");
+      exit(1);
+    }
+    printf("Resuming from step %d\n", first);
+    settings.stop_step = first - 1;
+  }
+  if ((settings.resume || settings.checkpoint > 0) && settings.aco_async)
+    printf("Checkpoints are not supported by the asynchronous ACO\n");
 
-  for (step=0; step<settings.aco_steps; step++) {
+  // trace the ants and the steps??
+  if (settings.trace && trace_open(first)) {
+    fprintf(stderr, "Error creating the trace\nAborting.\n");
+    exit(1);
+  }
 
-    // print step info
-    printf("Step %d\n", step);
+  printf("ACO steps :\n");
 
-    // reset lbest
-    [lbest clear];
+  if (settings.aco_async) {
+    // evaluate the ants asynchronously (all the steps at once)
+    AsyncACO *async = [[AsyncACO alloc] initWithPhero:phero
+						gbest:gbest
+						lamda:lamda];
+    if (workers_count() > 0)
+      [async runOnWorkers];
+    else
+      [async runWithThreads:settings.ant_threads];
+    [async release];
+  } else
+    for (step=first; step<settings.aco_steps; step++) {
+
+      // print step info
+      printf("Step %d\n", step);
+
+      // reset lbest
+      [lbest clear];
+      // phero is fixed during the step
+      prepare_graphs(phero);
+
+      if (workers_count() > 0) {
+	// evaluate the ants on the worker processes
+	pool = [[NSAutoreleasePool alloc] init];
+	run_ants_remote(phero, step, lbest);
+	[pool release];
+      } else if (settings.ant_threads > 1) {
+	// evaluate the ants concurrently
+	pool = [[NSAutoreleasePool alloc] init];
+	run_ants(phero, step, lbest);
+	[pool release];
+      } else
+	for (ant=0; ant<settings.aco_ants; ant++) {
+	  // allocate new pool
+	  pool = [[NSAutoreleasePool alloc] init];
+	  // generate solution
+	  solution = [Solution generateWith:phero
+				    forStep:step
+				     andAnt:ant];
+	  // update lbest
+	  [lbest updateWith:solution];
+	  // empty pool
+	  [pool release];
+	}
+
+      // report the ants that were not evaluated
+      if (settings.gcache)
+	printf("Duplicate ants : %d/%d\n", duplicates, settings.aco_ants);
+      duplicates = 0;
+
+      // update pheromone matrix with lbest
+      update_phero(phero, lbest, 1.);
+      // update gbest with lbest
+      [gbest updateWith:lbest];
+      // update pheromone matrix with gbest
+      update_phero(phero, gbest, 1.);
+      // perform pheromone evaporation
+      evaporate_phero(phero, settings.aco_rho);
+      // update vector of mean lamda factor 
+      update_lamda(lamda, phero, step);
+      // trace the pheromones at the end of the step
+      if (settings.trace)
+	trace_phero(step, phero);
+
+      // stop early?? (before the checkpoint, which saves the stall state)
+      stop = converged(lamda, phero, gbest, step);
+
+      // save a checkpoint (every settings.checkpoint steps and at the end)
+      // once the trace of the steps so far is on disk
+      if (settings.checkpoint > 0 && workers_count() == 0 &&
+	  ((step + 1) % settings.checkpoint == 0 || step + 1 == settings.aco_steps || stop) &&
+	  (trace_flush() || checkpoint_save(step + 1, phero, gbest, lamda)))
+	fprintf(stderr, "Error saving the checkpoint of step %d\n", step);
+
+      if (stop)
+	break;
 
-    for (ant=0; ant<settings.aco_ants; ant++) {
-      // allocate new pool
-      pool = [[NSAutoreleasePool alloc] init];
-      // generate solution
-      solution = [Solution generateWith:phero];
-      // update lbest
-      [lbest updateWith:solution];
-      // empty pool
-      [pool release];
     }
 
-    // update pheromone matrix with lbest
-    update_phero(phero, lbest);
-    // update gbest with lbest
-    [gbest updateWith:lbest];
-    // update pheromone matrix with gbest
-    update_phero(phero, gbest);
-    // perform pheromone evaporation
-    evaporate_phero(phero);
-    // update vector of mean lamda factor 
-    update_lamda(lamda, phero, step);
-
-  }
+  // write the rest of the trace
+  trace_close();
 
   // calculate and store duration
   settings.duration = labs(round([settings.start timeIntervalSinceNow]));
   // print duration
   printf("\nFinished :-)\nDuration : %s\n", [sec_to_nsstring(settings.duration) UTF8String]);
+  if (settings.stop_reason != STOP_NONE)
+    printf("Stopped early at step %d\n", settings.stop_step);
+  // print cache statistics
+  if (settings.cache)
+    printf("Training cache : %s\n", [[settings.cache description] UTF8String]);
+  if (settings.gcache)
+    printf("Graph cache : %s\n", [[settings.gcache description] UTF8String]);
 
   // release objects
   [lbest release];
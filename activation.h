@@ -0,0 +1,42 @@
+/* Batched activation kernels for RNN/DRNN prediction
+
+   The kernels apply the logistic function (sigmoid0 with mu=1 and
+   lamda=1, see common.h) to whole rows or columns of pre-activations.
+   They use SSE2/AVX2 where available (see simd.h) and a fast exp()
+   approximation :
+
+   ** exp(x) = 2^k * p(r), with k = round(x / ln2) and r = x - k * ln2
+      (Cody-Waite reduction, |r| <= ln2 / 2)
+   ** p is the degree-12 Taylor polynomial of exp, so the truncation
+      error is below 2e-16 and the total relative error of act_exp()
+      stays below 1e-15 (i.e. a few ulps) for x in [-708, 708]
+   ** arguments outside [-708, 708] are clamped, so the result never
+      overflows or becomes denormal; the sigmoid saturates correctly
+ */
+
+#ifndef ACTIVATION_H_
+#define ACTIVATION_H_
+
+#include <stddef.h>
+
+
+// fast exp() approximation (see above)
+double act_exp(double x);
+
+// x[i] = act_exp(x[i]) using the code path of the given SIMD level
+// (see simd.h; the CPU must support it) -- for checking the paths
+void act_exp_path(double *x, size_t n, int level);
+
+// u[i] = 1 / (1 + exp(-(u[i] + b[i])))
+// b may be NULL (i.e. no bias terms)
+void act_sigmoid(double *u, const double *b, size_t n);
+
+// DRNN leaky integration :
+// u[i] = a[i] * sigmoid(u[i] + b[i]) + (1 - a[i]) * x[i]
+// where a[i] = delta_t / T[i] is precomputed by the caller
+// b may be NULL (i.e. no bias terms)
+void act_decay(double *u, const double *b, const double *a,
+	       const double *x, size_t n);
+
+
+#endif // ACTIVATION_H_
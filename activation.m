@@ -0,0 +1,366 @@
+/* Batched activation kernels -- see activation.h */
+
+#include "activation.h"
+#include "simd.h"
+
+#include <stdint.h> // for uint64_t
+#include <string.h> // for memcpy()
+
+
+// limits of the argument of exp()
+#define ACT_EXP_MAX 708.
+#define ACT_EXP_MIN -708.
+
+// 1/ln2 and ln2 (split in two parts for the Cody-Waite reduction)
+#define ACT_LOG2E 1.4426950408889634074
+#define ACT_LN2_HI 6.93145751953125e-1
+#define ACT_LN2_LO 1.42860682030941723212e-6
+
+// 1.5 * 2^52 :: adding it rounds a double to the nearest integer
+// which ends up in the low bits of the mantissa
+#define ACT_ROUND 6755399441055744.
+
+// coefficients of the Taylor polynomial (1/k!)
+#define ACT_C2 5.0000000000000000000e-1
+#define ACT_C3 1.6666666666666666667e-1
+#define ACT_C4 4.1666666666666666667e-2
+#define ACT_C5 8.3333333333333333333e-3
+#define ACT_C6 1.3888888888888888889e-3
+#define ACT_C7 1.9841269841269841270e-4
+#define ACT_C8 2.4801587301587301587e-5
+#define ACT_C9 2.7557319223985890653e-6
+#define ACT_C10 2.7557319223985890653e-7
+#define ACT_C11 2.5052108385441718775e-8
+#define ACT_C12 2.0876756987868098979e-9
+
+
+
+//==============================================================
+//                       SCALAR CODE
+//==============================================================
+
+// NOTE : the order of the operations below is replicated exactly
+// in the SIMD code paths, so that all paths agree to the bit
+
+static inline double exp_scalar(double x) {
+
+    double kd, r, p;
+    uint64_t bits;
+
+    // clamp argument (same semantics as minpd/maxpd)
+    x = (x < ACT_EXP_MAX) ? x : ACT_EXP_MAX;
+    x = (x > ACT_EXP_MIN) ? x : ACT_EXP_MIN;
+    // k = round(x / ln2)
+    kd = x * ACT_LOG2E + ACT_ROUND;
+    memcpy(&bits, &kd, sizeof(double));
+    kd -= ACT_ROUND;
+    // r = x - k * ln2
+    r = x - kd * ACT_LN2_HI;
+    r = r - kd * ACT_LN2_LO;
+    // p(r)
+    p = ACT_C12;
+    p = p * r + ACT_C11;
+    p = p * r + ACT_C10;
+    p = p * r + ACT_C9;
+    p = p * r + ACT_C8;
+    p = p * r + ACT_C7;
+    p = p * r + ACT_C6;
+    p = p * r + ACT_C5;
+    p = p * r + ACT_C4;
+    p = p * r + ACT_C3;
+    p = p * r + ACT_C2;
+    p = p * r + 1.;
+    p = p * r + 1.;
+    // 2^k (the exponent field is (k + 1023) << 52)
+    bits = (bits + 1023) << 52;
+    memcpy(&kd, &bits, sizeof(double));
+
+    return p * kd;
+
+}
+
+
+static inline double sigmoid_scalar(double v) {
+
+    return 1. / (1. + exp_scalar(-v));
+
+}
+
+
+
+double act_exp(double x) {
+
+    return exp_scalar(x);
+
+}
+
+
+
+//==============================================================
+//                        SSE2 CODE
+//==============================================================
+
+#if SIMD_X86
+
+static inline __m128d exp_sse2(__m128d x) {
+
+    __m128d kd, r, p;
+    __m128i bits;
+
+    x = _mm_min_pd(x, _mm_set1_pd(ACT_EXP_MAX));
+    x = _mm_max_pd(x, _mm_set1_pd(ACT_EXP_MIN));
+    kd = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(ACT_LOG2E)),
+		    _mm_set1_pd(ACT_ROUND));
+    bits = _mm_castpd_si128(kd);
+    kd = _mm_sub_pd(kd, _mm_set1_pd(ACT_ROUND));
+    r = _mm_sub_pd(x, _mm_mul_pd(kd, _mm_set1_pd(ACT_LN2_HI)));
+    r = _mm_sub_pd(r, _mm_mul_pd(kd, _mm_set1_pd(ACT_LN2_LO)));
+    p = _mm_set1_pd(ACT_C12);
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C11));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C10));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C9));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C8));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C7));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C6));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C5));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C4));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C3));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(ACT_C2));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.));
+    bits = _mm_slli_epi64(_mm_add_epi64(bits, _mm_set1_epi64x(1023)), 52);
+
+    return _mm_mul_pd(p, _mm_castsi128_pd(bits));
+
+}
+
+
+static inline __m128d sigmoid_sse2(__m128d v) {
+
+    // -v (flip the sign bit)
+    v = _mm_xor_pd(v, _mm_set1_pd(-0.));
+    return _mm_div_pd(_mm_set1_pd(1.),
+		      _mm_add_pd(_mm_set1_pd(1.), exp_sse2(v)));
+
+}
+
+
+// the SIMD loops return the number of processed elements
+static size_t act_exp_sse2(double *x, size_t n) {
+
+    size_t i;
+
+    for (i=0; i+2<=n; i+=2)
+	_mm_storeu_pd(x + i, exp_sse2(_mm_loadu_pd(x + i)));
+
+    return i;
+
+}
+
+
+static size_t act_sigmoid_sse2(double *u, const double *b, size_t n) {
+
+    size_t i;
+    __m128d v;
+
+    for (i=0; i+2<=n; i+=2) {
+	v = _mm_loadu_pd(u + i);
+	if (b)
+	    v = _mm_add_pd(v, _mm_loadu_pd(b + i));
+	_mm_storeu_pd(u + i, sigmoid_sse2(v));
+    }
+
+    return i;
+
+}
+
+
+static size_t act_decay_sse2(double *u, const double *b, const double *a,
+			     const double *x, size_t n)
+{
+
+    size_t i;
+    __m128d v, av;
+
+    for (i=0; i+2<=n; i+=2) {
+	v = _mm_loadu_pd(u + i);
+	if (b)
+	    v = _mm_add_pd(v, _mm_loadu_pd(b + i));
+	av = _mm_loadu_pd(a + i);
+	v = _mm_add_pd(_mm_mul_pd(av, sigmoid_sse2(v)),
+		       _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(1.), av),
+				  _mm_loadu_pd(x + i)));
+	_mm_storeu_pd(u + i, v);
+    }
+
+    return i;
+
+}
+
+
+
+//==============================================================
+//                        AVX2 CODE
+//==============================================================
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256d exp_avx2(__m256d x) {
+
+    __m256d kd, r, p;
+    __m256i bits;
+
+    x = _mm256_min_pd(x, _mm256_set1_pd(ACT_EXP_MAX));
+    x = _mm256_max_pd(x, _mm256_set1_pd(ACT_EXP_MIN));
+    kd = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(ACT_LOG2E)),
+		       _mm256_set1_pd(ACT_ROUND));
+    bits = _mm256_castpd_si256(kd);
+    kd = _mm256_sub_pd(kd, _mm256_set1_pd(ACT_ROUND));
+    r = _mm256_sub_pd(x, _mm256_mul_pd(kd, _mm256_set1_pd(ACT_LN2_HI)));
+    r = _mm256_sub_pd(r, _mm256_mul_pd(kd, _mm256_set1_pd(ACT_LN2_LO)));
+    p = _mm256_set1_pd(ACT_C12);
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C11));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C10));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C9));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C8));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C7));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C6));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C5));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C4));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C3));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ACT_C2));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.));
+    bits = _mm256_slli_epi64(_mm256_add_epi64(bits,
+					      _mm256_set1_epi64x(1023)), 52);
+
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+
+}
+
+
+static inline AVX2 __m256d sigmoid_avx2(__m256d v) {
+
+    v = _mm256_xor_pd(v, _mm256_set1_pd(-0.));
+    return _mm256_div_pd(_mm256_set1_pd(1.),
+			 _mm256_add_pd(_mm256_set1_pd(1.), exp_avx2(v)));
+
+}
+
+
+static AVX2 size_t act_exp_avx2(double *x, size_t n) {
+
+    size_t i;
+
+    for (i=0; i+4<=n; i+=4)
+	_mm256_storeu_pd(x + i, exp_avx2(_mm256_loadu_pd(x + i)));
+
+    return i;
+
+}
+
+
+static AVX2 size_t act_sigmoid_avx2(double *u, const double *b, size_t n) {
+
+    size_t i;
+    __m256d v;
+
+    for (i=0; i+4<=n; i+=4) {
+	v = _mm256_loadu_pd(u + i);
+	if (b)
+	    v = _mm256_add_pd(v, _mm256_loadu_pd(b + i));
+	_mm256_storeu_pd(u + i, sigmoid_avx2(v));
+    }
+
+    return i;
+
+}
+
+
+static AVX2 size_t act_decay_avx2(double *u, const double *b, const double *a,
+				  const double *x, size_t n)
+{
+
+    size_t i;
+    __m256d v, av;
+
+    for (i=0; i+4<=n; i+=4) {
+	v = _mm256_loadu_pd(u + i);
+	if (b)
+	    v = _mm256_add_pd(v, _mm256_loadu_pd(b + i));
+	av = _mm256_loadu_pd(a + i);
+	v = _mm256_add_pd(_mm256_mul_pd(av, sigmoid_avx2(v)),
+			  _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.), av),
+					_mm256_loadu_pd(x + i)));
+	_mm256_storeu_pd(u + i, v);
+    }
+
+    return i;
+
+}
+
+#endif // SIMD_X86
+
+
+
+//==============================================================
+//                       DISPATCHERS
+//==============================================================
+
+void act_exp_path(double *x, size_t n, int level) {
+
+    size_t i = 0;
+
+#if SIMD_X86
+    if (level >= SIMD_AVX2)
+	i = act_exp_avx2(x, n);
+    else if (level >= SIMD_SSE2)
+	i = act_exp_sse2(x, n);
+#endif
+
+    // remaining elements
+    for (; i<n; i++)
+	x[i] = exp_scalar(x[i]);
+
+}
+
+
+
+void act_sigmoid(double *u, const double *b, size_t n) {
+
+    size_t i = 0;
+
+#if SIMD_X86
+    if (simd_level() >= SIMD_AVX2)
+	i = act_sigmoid_avx2(u, b, n);
+    else
+	i = act_sigmoid_sse2(u, b, n);
+#endif
+
+    // remaining elements
+    for (; i<n; i++)
+	u[i] = sigmoid_scalar(b ? u[i] + b[i] : u[i]);
+
+}
+
+
+
+void act_decay(double *u, const double *b, const double *a,
+	       const double *x, size_t n)
+{
+
+    size_t i = 0;
+
+#if SIMD_X86
+    if (simd_level() >= SIMD_AVX2)
+	i = act_decay_avx2(u, b, a, x, n);
+    else
+	i = act_decay_sse2(u, b, a, x, n);
+#endif
+
+    // remaining elements
+    for (; i<n; i++)
+	u[i] = a[i] * sigmoid_scalar(b ? u[i] + b[i] : u[i]) +
+	    (1. - a[i]) * x[i];
+
+}
@@ -0,0 +1,234 @@
+/* netinf_bench : PSO micro-benchmark
+
+   Sweeps the dimensionality, the swarm size, the neighborhood strategy
+   and the inertia weight strategy of PSO on the benchmark functions of
+   pso.m and on the training of an RNN/DRNN (full model) against a data
+   file (see data/). Every run prints one CSV line to stdout :
+
+   problem,dim,size,nhood,w,seed,steps,evals,wall_time,evals_per_sec,
+   steps_to_goal,error
+
+   ** evals : number of objective evaluations, i.e. size * (steps + 1)
+      (the initial swarm is evaluated once before the first step)
+   ** steps_to_goal : the step at which the goal was achieved (-1 if
+      the goal was not achieved within the allowed steps)
+   ** wall_time : in seconds
+ */
+
+#import <Foundation/Foundation.h>
+#import <getopt.h>
+
+#import "GSL.h"
+#import "Dynamics.h"
+#import "Graph.h"
+#import "pso.h"
+#import "grad.h"
+#import "RNN.h"
+
+
+// DEFAULTS
+#define BENCH_DATA "data/xu.data"
+#define BENCH_STEPS 1000
+#define BENCH_SEED 1
+#define BENCH_REPS 1
+
+
+// a benchmark function and its settings
+typedef struct {
+  const char *name;
+  pso_obj_fun_t fun;
+  void (*set_settings)(pso_settings_t *);
+} bench_fun_t;
+
+static bench_fun_t bench_funs[] = {
+  {"sphere", pso_sphere, pso_set_sphere_settings},
+  {"rosenbrock", pso_rosenbrock, pso_set_rosenbrock_settings},
+  {"griewank", pso_griewank, pso_set_griewank_settings},
+  {"rastrigin", pso_rastrigin, pso_set_rastrigin_settings}
+};
+
+// the sweep
+static int bench_dims[] = {2, 10, 30};
+static int bench_sizes[] = {0, 20, 50}; // 0 : calc_swarm_size(dim)
+static int bench_nhoods[] = {PSO_NHOOD_GLOBAL, PSO_NHOOD_RING, PSO_NHOOD_RANDOM};
+static int bench_ws[] = {PSO_W_CONST, PSO_W_LIN_DEC};
+
+#define COUNT(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static const char *nhood_names[] = {"global", "ring", "random"};
+static const char *w_names[] = {"const", "lin_dec"};
+
+
+
+void print_help() {
+
+  printf("usage: netinf_bench [options]\n");
+  printf("  -f FILE : the data file of the RNN benchmark (default: %s)\n", BENCH_DATA);
+  printf("  -n INT : the number of PSO steps per run (default: %d)\n", BENCH_STEPS);
+  printf("  -r INT : the number of repetitions per configuration (default: %d)\n", BENCH_REPS);
+  printf("  -s INT : the RNG seed of the first repetition (default: %d)\n", BENCH_SEED);
+
+}
+
+
+
+// print the CSV line of a finished run
+void print_run(const char *problem, pso_settings_t *pso_settings,
+	       pso_result_t *solution, double wall_time) {
+
+  long evals = (long)pso_settings->size * (solution->steps + 1);
+
+  printf("%s,%d,%d,%s,%s,%lu,%d,%ld,%.6f,%.1f,%d,%.10e\n",
+	 problem, pso_settings->dim, pso_settings->size,
+	 nhood_names[pso_settings->nhood_strategy],
+	 w_names[pso_settings->w_strategy],
+	 (unsigned long)pso_settings->seed,
+	 solution->steps, evals, wall_time,
+	 wall_time > 0 ? evals / wall_time : 0.,
+	 solution->error <= pso_settings->goal ? solution->steps : -1,
+	 solution->error);
+  fflush(stdout);
+
+}
+
+
+
+// set up the settings of a run (dim must already be set)
+void set_run_settings(pso_settings_t *pso_settings, int size, int nhood,
+		      int w, int steps, unsigned long seed) {
+
+  pso_settings->size = size ? size : calc_swarm_size(pso_settings->dim);
+  pso_settings->nhood_strategy = nhood;
+  pso_settings->w_strategy = w;
+  pso_settings->steps = steps;
+  pso_settings->print_every = 0;
+  // each run creates (and frees) its own RNG
+  pso_settings->rng = NULL;
+  pso_settings->seed = seed;
+
+}
+
+
+
+// benchmark functions
+void bench_functions(int steps, int reps, unsigned long seed) {
+
+  int f, d, s, n, w, r;
+  pso_settings_t pso_settings;
+  pso_result_t solution;
+  NSDate *start;
+
+  for (f=0; f<COUNT(bench_funs); f++)
+    for (d=0; d<COUNT(bench_dims); d++) {
+      double gbest[bench_dims[d]];
+      solution.gbest = gbest;
+      for (s=0; s<COUNT(bench_sizes); s++)
+	for (n=0; n<COUNT(bench_nhoods); n++)
+	  for (w=0; w<COUNT(bench_ws); w++)
+	    for (r=0; r<reps; r++) {
+	      pso_set_default_settings(&pso_settings);
+	      bench_funs[f].set_settings(&pso_settings);
+	      pso_settings.dim = bench_dims[d];
+	      set_run_settings(&pso_settings, bench_sizes[s], bench_nhoods[n],
+			       bench_ws[w], steps, seed + r);
+	      start = [NSDate date];
+	      pso_solve(bench_funs[f].fun, NULL, &solution, &pso_settings);
+	      print_run(bench_funs[f].name, &pso_settings, &solution,
+			-[start timeIntervalSinceNow]);
+	    }
+    }
+
+}
+
+
+
+// RNN training (full model, all nodes regulate all nodes)
+void bench_rnn(Dynamics *tdata, int steps, int reps, unsigned long seed) {
+
+  Class classes[] = {[RNN class], [DRNN class]};
+  const char *names[] = {"rnn", "drnn"};
+  int c, s, n, w, r;
+  pso_settings_t pso_settings;
+  pso_result_t solution;
+  NSDate *start;
+  NSAutoreleasePool *pool;
+  RNN *rnn;
+
+  for (c=0; c<COUNT(classes); c++)
+    for (s=0; s<COUNT(bench_sizes); s++)
+      for (n=0; n<COUNT(bench_nhoods); n++)
+	for (w=0; w<COUNT(bench_ws); w++)
+	  for (r=0; r<reps; r++) {
+	    pool = [[NSAutoreleasePool alloc] init];
+	    rnn = [classes[c] rnnWithNodes:[tdata vars]];
+	    // same settings as netinf (see set_pso_settings())
+	    pso_set_default_settings(&pso_settings);
+	    pso_settings.x_lo = -20;
+	    pso_settings.x_hi = 20;
+	    pso_settings.goal = 1e-10;
+	    pso_settings.dim = [classes[c] calcDimForNodes:[tdata vars]];
+	    set_run_settings(&pso_settings, bench_sizes[s], bench_nhoods[n],
+			     bench_ws[w], steps, seed + r);
+	    start = [NSDate date];
+	    solution.error = [rnn trainUsingDynamics:tdata
+				     withPSOSettings:&pso_settings];
+	    // the trainer does not return the steps; pso_settings.step
+	    // is the last step that was started (the goal is checked
+	    // at the beginning of each step)
+	    solution.steps = solution.error <= pso_settings.goal ? 
+	      pso_settings.step : pso_settings.step + 1;
+	    print_run(names[c], &pso_settings, &solution,
+		      -[start timeIntervalSinceNow]);
+	    [pool release];
+	  }
+
+}
+
+
+
+int main(int argc, char **argv) {
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  const char *dpath = BENCH_DATA;
+  int steps = BENCH_STEPS;
+  int reps = BENCH_REPS;
+  unsigned long seed = BENCH_SEED;
+  int c;
+
+  while ((c = getopt(argc, argv, "f:n:r:s:h")) != -1)
+    switch (c) {
+    case 'f':
+      dpath = optarg;
+      break;
+    case 'n':
+      steps = atoi(optarg);
+      break;
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 's':
+      seed = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      print_help();
+      return 1;
+    }
+
+  // load the data of the RNN benchmark
+  Dynamics *tdata = [[Dynamics alloc] initFromFile:[NSString stringWithUTF8String:dpath]];
+  if (! tdata) {
+    fprintf(stderr, "Error loading data file %s\nAborting.\n", dpath);
+    return -1;
+  }
+
+  // CSV header
+  printf("problem,dim,size,nhood,w,seed,steps,evals,wall_time,evals_per_sec,steps_to_goal,error\n");
+
+  bench_functions(steps, reps, seed);
+  bench_rnn(tdata, steps, reps, seed);
+
+  [tdata release];
+  [pool release];
+  return 0;
+
+}
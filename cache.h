@@ -0,0 +1,178 @@
+#import  <Foundation/Foundation.h>
+#import "GSL.h"
+#import "pso.h"
+#import "Graph.h"
+
+
+//***********************************************************************
+//***********************************************************************
+
+/*
+  TrainCache : a memo of per-target trainings (problem decomposition)
+
+  The training of a target depends only on its set of regulators (and
+  on the RNN type, the PSO settings and the training and evaluation
+  modes), so the ACO keeps proposing trainings that have already been
+  performed. The cache stores the optimization error and the trained
+  parameters of each target under a key formed by all the above (see
+  keyForTarget:...).
+
+  ** the parameters are stored in the order of the (sorted) regulators
+     of the key, followed by the bias term (and the time constant)
+  ** the memory used by the entries is capped; when the cap is reached
+     the oldest entries are evicted (FIFO)
+  ** the cache can be used by several threads (ants) concurrently
+ */
+
+@interface TrainCache : NSObject {
+
+  NSMutableDictionary *entries; // key -> [error, parameters]
+  NSMutableArray *order; // the keys in insertion order (for eviction)
+  unsigned head; // the first key of order that has not been evicted
+  unsigned long added; // the number of entries added so far
+  size_t capacity; // max memory used by the entries (bytes)
+  size_t used; // memory currently used by the entries (bytes)
+  NSLock *lock; // serializes the access of the threads
+
+  // statistics
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+
+}
+
++ (id) cacheWithCapacity:(size_t)bytes;
+
+// form the key of a target's training
+// regs : the regulators of target (NSNumbers, sorted in ascending order)
+// train_mode, grad_steps, eval_mode : see settings (params.h)
++ (NSString *) keyForTarget:(int)trg
+	     withRegulators:(NSArray *)regs
+		 modelClass:(Class)cls
+		psoSettings:(pso_settings_t *)pso_settings
+		  trainMode:(int)train_mode
+		  gradSteps:(int)grad_steps
+		   evalMode:(int)eval_mode;
+
+// DESIGNATED
+- (id) initWithCapacity:(size_t)bytes;
+
+- (void) dealloc;
+
+// return the parameters stored under key (nil if there are none)
+// and store the corresponding error in *err
+// (updates the hit/miss counters)
+- (GSLVector *) paramsForKey:(NSString *)key
+		       error:(double *)err;
+
+// store the parameters and the error of a training under key
+- (void) setParams:(GSLVector *)params
+	     error:(double)err
+	    forKey:(NSString *)key;
+
+// write a batch of the entries (in insertion order) to a binary stream :
+// those added after the first mark entries (see added) that are
+// still in the cache (mark 0 : all the entries)
+// returns NO on error
+- (BOOL) writeToStream:(FILE *)stream
+		 since:(unsigned long)mark;
+
+// read the batches of a binary stream (see writeToStream:since:) up to
+// offset end and add the last n of their entries, i.e. the entries of
+// the cache that wrote them; *count receives the number of entries
+// read; returns NO on error
+- (BOOL) readFromStream:(FILE *)stream
+		  until:(long)end
+		   last:(int)n
+		  count:(int *)count;
+
+// the number of entries added so far (including the evicted ones)
+- (unsigned long) added;
+
+- (unsigned long) hits;
+- (unsigned long) misses;
+- (int) count;
+
+- (NSString *) description;
+
+@end
+
+
+
+//***********************************************************************
+//***********************************************************************
+
+/*
+  GraphCache : a memo of whole-graph evaluations
+
+  As the pheromone matrix sharpens, the ACO generates the same graph
+  several times (in the same step and across steps). The cache maps
+  the fingerprint of a graph (see cgraph_fingerprint()) to the
+  per-target errors of its evaluation, so that a duplicate graph is
+  not evaluated again.
+
+  ** the number of entries is capped; when the cap is reached the
+     oldest entries are evicted (FIFO)
+  ** the cache can be used by several threads (ants) concurrently
+ */
+
+@interface GraphCache : NSObject {
+
+  NSMutableDictionary *entries; // fingerprint -> errors
+  NSMutableArray *order; // the keys in insertion order (for eviction)
+  unsigned head; // the first key of order that has not been evicted
+  unsigned long added; // the number of entries added so far
+  int capacity; // max number of entries
+  NSLock *lock; // serializes the access of the threads
+
+  // statistics
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+
+}
+
++ (id) cacheWithCapacity:(int)count;
+
+// the key of a graph (its 128-bit fingerprint)
++ (NSData *) keyForGraph:(Digraph *)g;
+
+// DESIGNATED
+- (id) initWithCapacity:(int)count;
+
+- (void) dealloc;
+
+// return the errors stored under key (nil if there are none)
+// (updates the hit/miss counters)
+- (GSLVector *) errorsForKey:(NSData *)key;
+
+// store the errors of an evaluation under key
+- (void) setErrors:(GSLVector *)errors
+	    forKey:(NSData *)key;
+
+// write a batch of the entries (in insertion order) to a binary stream :
+// those added after the first mark entries (see added) that are
+// still in the cache (mark 0 : all the entries)
+// returns NO on error
+- (BOOL) writeToStream:(FILE *)stream
+		 since:(unsigned long)mark;
+
+// read the batches of a binary stream (see writeToStream:since:) up to
+// offset end and add the last n of their entries, i.e. the entries of
+// the cache that wrote them; *count receives the number of entries
+// read; returns NO on error
+- (BOOL) readFromStream:(FILE *)stream
+		  until:(long)end
+		   last:(int)n
+		  count:(int *)count;
+
+// the number of entries added so far (including the evicted ones)
+- (unsigned long) added;
+
+- (unsigned long) hits;
+- (unsigned long) misses;
+- (int) count;
+
+- (NSString *) description;
+
+@end
@@ -0,0 +1,573 @@
+#import "cache.h"
+
+#import <stdint.h>
+#import <string.h>
+
+
+// approximate memory overhead of an entry (objects and bookkeeping)
+#define CACHE_ENTRY_OVERHEAD 256
+
+
+// approximate memory used by an entry
+static size_t entry_size(NSString *key, GSLVector *params) {
+
+  return sizeof(double) * [params count] + [key length] + CACHE_ENTRY_OVERHEAD;
+
+}
+
+
+
+//***********************************************************************
+//***********************************************************************
+@implementation TrainCache
+
+
++ (id) cacheWithCapacity:(size_t)bytes {
+
+  return [[[TrainCache alloc] initWithCapacity:bytes] autorelease];
+
+}
+
+
+
++ (NSString *) keyForTarget:(int)trg
+	     withRegulators:(NSArray *)regs
+		 modelClass:(Class)cls
+		psoSettings:(pso_settings_t *)s
+		  trainMode:(int)train_mode
+		  gradSteps:(int)grad_steps
+		   evalMode:(int)eval_mode
+{
+
+  // the doubles are printed exactly (%.17g), so that different
+  // settings never share a key
+  return [NSString stringWithFormat:@"%d:%@|%@|%d,%d,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%d,%d,%d,%d|%d,%.17g,%.17g,%d,%.17g|%d,%d,%d",
+		   trg, [regs componentsJoinedByString:@","],
+		   NSStringFromClass(cls),
+		   s->steps, s->size, s->x_lo, s->x_hi, s->goal,
+		   s->c1, s->c2, s->w_max, s->w_min,
+		   s->clamp_pos, s->nhood_strategy, s->nhood_size,
+		   s->w_strategy,
+		   s->stall_steps, s->stall_tol, s->min_diameter,
+		   s->stall_strategy, s->restart_frac,
+		   train_mode, grad_steps, eval_mode];
+
+}
+
+
+
+- (id) init {
+
+  return [self initWithCapacity:0];
+
+}
+
+
+
+- (id) initWithCapacity:(size_t)bytes {
+
+  self = [super init];
+  if (!self)
+    return nil;
+
+  entries = [[NSMutableDictionary alloc] init];
+  order = [[NSMutableArray alloc] init];
+  head = 0;
+  added = 0;
+  capacity = bytes;
+  used = 0;
+  hits = misses = evictions = 0;
+  lock = [[NSLock alloc] init];
+
+  return self;
+
+}
+
+
+
+- (void) dealloc {
+
+  [entries release];
+  [order release];
+  [lock release];
+  [super dealloc];
+
+}
+
+
+
+- (GSLVector *) paramsForKey:(NSString *)key
+		       error:(double *)err
+{
+
+  NSArray *entry;
+  GSLVector *params = nil;
+
+  [lock lock];
+  entry = [entries objectForKey:key];
+  if (entry) {
+    hits += 1;
+    *err = [[entry objectAtIndex:0] doubleValue];
+    // the entry could be evicted by another thread
+    params = [[[entry objectAtIndex:1] retain] autorelease];
+  } else
+    misses += 1;
+  [lock unlock];
+
+  return params;
+
+}
+
+
+
+- (void) setParams:(GSLVector *)params
+	     error:(double)err
+	    forKey:(NSString *)key
+{
+
+  NSString *oldest;
+  size_t size = entry_size(key, params);
+
+  [lock lock];
+
+  // does it fit at all??
+  if (size > capacity || [entries objectForKey:key]) {
+    [lock unlock];
+    return;
+  }
+
+  // evict the oldest entries until the new one fits
+  while (used + size > capacity) {
+    oldest = [order objectAtIndex:head];
+    used -= entry_size(oldest, [[entries objectForKey:oldest] objectAtIndex:1]);
+    [entries removeObjectForKey:oldest];
+    head += 1;
+    evictions += 1;
+  }
+  // drop the keys of the evicted entries once they are half of order
+  // (so that an eviction costs O(1) on average)
+  if (head > 0 && 2 * head >= [order count]) {
+    [order removeObjectsInRange:NSMakeRange(0, head)];
+    head = 0;
+  }
+
+  // store a copy of the parameters
+  GSLVector *p = [params copy];
+  [entries setObject:[NSArray arrayWithObjects:[NSNumber numberWithDouble:err],
+			      p, nil]
+	      forKey:key];
+  [p release];
+  [order addObject:key];
+  used += size;
+  added += 1;
+
+  [lock unlock];
+
+}
+
+
+
+- (BOOL) writeToStream:(FILE *)stream
+		 since:(unsigned long)mark
+{
+
+  NSString *key;
+  NSArray *entry;
+  GSLVector *params;
+  const char *ckey;
+  int32_t n, len, plen;
+  double err;
+  BOOL ok;
+  int i, first;
+
+  [lock lock];
+
+  // the entries added after mark that have not been evicted
+  n = [order count] - head;
+  if (added - mark < n)
+    n = added - mark;
+  first = [order count] - n;
+
+  ok = fwrite(&n, sizeof(n), 1, stream) == 1;
+  // entry :: key length, key, error, parameters length, parameters
+  for (i=0; ok && i<n; i++) {
+    key = [order objectAtIndex:first + i];
+    entry = [entries objectForKey:key];
+    params = [entry objectAtIndex:1];
+    ckey = [key UTF8String];
+    len = strlen(ckey);
+    err = [[entry objectAtIndex:0] doubleValue];
+    plen = [params count];
+    ok = fwrite(&len, sizeof(len), 1, stream) == 1 &&
+      fwrite(ckey, 1, len, stream) == len &&
+      fwrite(&err, sizeof(err), 1, stream) == 1 &&
+      fwrite(&plen, sizeof(plen), 1, stream) == 1 &&
+      gsl_vector_fwrite(stream, [params vec]) == 0;
+  }
+
+  [lock unlock];
+
+  return ok;
+
+}
+
+
+
+- (BOOL) readFromStream:(FILE *)stream
+		  until:(long)end
+		   last:(int)n
+		  count:(int *)count
+{
+
+  NSMutableArray *keys = [NSMutableArray array];
+  NSMutableArray *errs = [NSMutableArray array];
+  NSMutableArray *all = [NSMutableArray array];
+  GSLVector *params;
+  char *ckey;
+  int32_t nb, len, plen;
+  double err;
+  BOOL ok;
+  int i;
+
+  // the batches
+  while (ftell(stream) < end) {
+    if (fread(&nb, sizeof(nb), 1, stream) != 1 || nb < 0)
+      return NO;
+    for (i=0; i<nb; i++) {
+      if (fread(&len, sizeof(len), 1, stream) != 1 || len < 0)
+	return NO;
+      ckey = malloc(len + 1);
+      ok = fread(ckey, 1, len, stream) == len &&
+	fread(&err, sizeof(err), 1, stream) == 1 &&
+	fread(&plen, sizeof(plen), 1, stream) == 1 &&
+	plen > 0;
+      if (ok) {
+	ckey[len] = '\0';
+	params = [[GSLVector alloc] initWithSize:plen];
+	ok = gsl_vector_fread(stream, (gsl_vector *)[params vec]) == 0;
+	if (ok) {
+	  [keys addObject:[NSString stringWithUTF8String:ckey]];
+	  [errs addObject:[NSNumber numberWithDouble:err]];
+	  [all addObject:params];
+	}
+	[params release];
+      }
+      free(ckey);
+      if (!ok)
+	return NO;
+    }
+  }
+  if (ftell(stream) != end || n < 0 || n > [keys count])
+    return NO;
+
+  // the last n entries are those of the cache (in insertion order)
+  for (i=[keys count]-n; i<[keys count]; i++)
+    [self setParams:[all objectAtIndex:i]
+	      error:[[errs objectAtIndex:i] doubleValue]
+	     forKey:[keys objectAtIndex:i]];
+  *count = [keys count];
+
+  return YES;
+
+}
+
+
+
+- (unsigned long) added {
+
+  return added;
+
+}
+
+
+
+- (unsigned long) hits {
+
+  return hits;
+
+}
+
+
+
+- (unsigned long) misses {
+
+  return misses;
+
+}
+
+
+
+- (int) count {
+
+  return [entries count];
+
+}
+
+
+
+- (NSString *) description {
+
+  unsigned long lookups = hits + misses;
+
+  return [NSString stringWithFormat:@"%lu hits / %lu lookups (%.1f%%), %d entries (%.1f MB), %lu evictions",
+		   hits, lookups, lookups ? 100. * hits / lookups : 0.,
+		   [entries count], used / 1048576., evictions];
+
+}
+
+@end
+
+
+
+
+//***********************************************************************
+//***********************************************************************
+@implementation GraphCache
+
+
++ (id) cacheWithCapacity:(int)count {
+
+  return [[[GraphCache alloc] initWithCapacity:count] autorelease];
+
+}
+
+
+
++ (NSData *) keyForGraph:(Digraph *)g {
+
+  uint64_t fp[2];
+
+  cgraph_fingerprint([g compact], fp);
+
+  return [NSData dataWithBytes:fp
+			length:sizeof(fp)];
+
+}
+
+
+
+- (id) init {
+
+  return [self initWithCapacity:0];
+
+}
+
+
+
+- (id) initWithCapacity:(int)count {
+
+  self = [super init];
+  if (!self)
+    return nil;
+
+  entries = [[NSMutableDictionary alloc] init];
+  order = [[NSMutableArray alloc] init];
+  head = 0;
+  added = 0;
+  capacity = count;
+  hits = misses = evictions = 0;
+  lock = [[NSLock alloc] init];
+
+  return self;
+
+}
+
+
+
+- (void) dealloc {
+
+  [entries release];
+  [order release];
+  [lock release];
+  [super dealloc];
+
+}
+
+
+
+- (GSLVector *) errorsForKey:(NSData *)key {
+
+  GSLVector *errors;
+
+  [lock lock];
+  // the entry could be evicted by another thread
+  errors = [[[entries objectForKey:key] retain] autorelease];
+  if (errors)
+    hits += 1;
+  else
+    misses += 1;
+  [lock unlock];
+
+  return errors;
+
+}
+
+
+
+- (void) setErrors:(GSLVector *)errors
+	    forKey:(NSData *)key
+{
+
+  [lock lock];
+
+  if (capacity <= 0 || [entries objectForKey:key]) {
+    [lock unlock];
+    return;
+  }
+
+  // evict the oldest entry to make room for the new one
+  if ([order count] - head >= capacity) {
+    [entries removeObjectForKey:[order objectAtIndex:head]];
+    head += 1;
+    evictions += 1;
+  }
+  // drop the keys of the evicted entries once they are half of order
+  // (see TrainCache)
+  if (head > 0 && 2 * head >= [order count]) {
+    [order removeObjectsInRange:NSMakeRange(0, head)];
+    head = 0;
+  }
+
+  // store a copy of the errors
+  GSLVector *e = [errors copy];
+  [entries setObject:e
+	      forKey:key];
+  [e release];
+  [order addObject:key];
+  added += 1;
+
+  [lock unlock];
+
+}
+
+
+
+- (BOOL) writeToStream:(FILE *)stream
+		 since:(unsigned long)mark
+{
+
+  NSData *key;
+  GSLVector *errors;
+  int32_t n, len;
+  BOOL ok;
+  int i, first;
+
+  [lock lock];
+
+  // the entries added after mark that have not been evicted
+  n = [order count] - head;
+  if (added - mark < n)
+    n = added - mark;
+  first = [order count] - n;
+
+  ok = fwrite(&n, sizeof(n), 1, stream) == 1;
+  // entry :: fingerprint, errors length, errors
+  for (i=0; ok && i<n; i++) {
+    key = [order objectAtIndex:first + i];
+    errors = [entries objectForKey:key];
+    len = [errors count];
+    ok = fwrite([key bytes], 1, 2 * sizeof(uint64_t), stream) == 2 * sizeof(uint64_t) &&
+      fwrite(&len, sizeof(len), 1, stream) == 1 &&
+      gsl_vector_fwrite(stream, [errors vec]) == 0;
+  }
+
+  [lock unlock];
+
+  return ok;
+
+}
+
+
+
+- (BOOL) readFromStream:(FILE *)stream
+		  until:(long)end
+		   last:(int)n
+		  count:(int *)count
+{
+
+  NSMutableArray *keys = [NSMutableArray array];
+  NSMutableArray *all = [NSMutableArray array];
+  GSLVector *errors;
+  uint64_t fp[2];
+  int32_t nb, len;
+  BOOL ok;
+  int i;
+
+  // the batches
+  while (ftell(stream) < end) {
+    if (fread(&nb, sizeof(nb), 1, stream) != 1 || nb < 0)
+      return NO;
+    for (i=0; i<nb; i++) {
+      if (fread(fp, sizeof(uint64_t), 2, stream) != 2 ||
+	  fread(&len, sizeof(len), 1, stream) != 1 || len <= 0)
+	return NO;
+      errors = [[GSLVector alloc] initWithSize:len];
+      ok = gsl_vector_fread(stream, (gsl_vector *)[errors vec]) == 0;
+      if (ok) {
+	[keys addObject:[NSData dataWithBytes:fp
+				       length:sizeof(fp)]];
+	[all addObject:errors];
+      }
+      [errors release];
+      if (!ok)
+	return NO;
+    }
+  }
+  if (ftell(stream) != end || n < 0 || n > [keys count])
+    return NO;
+
+  // the last n entries are those of the cache (in insertion order)
+  for (i=[keys count]-n; i<[keys count]; i++)
+    [self setErrors:[all objectAtIndex:i]
+	     forKey:[keys objectAtIndex:i]];
+  *count = [keys count];
+
+  return YES;
+
+}
+
+
+
+- (unsigned long) added {
+
+  return added;
+
+}
+
+
+
+- (unsigned long) hits {
+
+  return hits;
+
+}
+
+
+
+- (unsigned long) misses {
+
+  return misses;
+
+}
+
+
+
+- (int) count {
+
+  return [entries count];
+
+}
+
+
+
+- (NSString *) description {
+
+  unsigned long lookups = hits + misses;
+
+  return [NSString stringWithFormat:@"%lu hits / %lu lookups (%.1f%%), %d entries, %lu evictions",
+		   hits, lookups, lookups ? 100. * hits / lookups : 0.,
+		   [entries count], evictions];
+
+}
+
+@end
@@ -0,0 +1,178 @@
+/* netinf_check : numerical checks of the fast kernels
+
+   Usage : netinf_check
+
+   ** exp : act_exp() (see activation.h) against exp() of libm on a
+      grid of [-708, 708], for every code path that the CPU supports
+      (scalar, SSE2, AVX2); fails if the relative error exceeds
+      CHECK_EXP_TOL or if the paths do not agree to the bit
+
+   ** grad : predict_target_grad() (see predict.h) against the central
+      differences of its MSE, for RNN and DRNN targets with a subset
+      and with all the nodes as regulators, on random data; fails if
+      the relative error of a derivative exceeds CHECK_GRAD_TOL
+
+   Prints one line per check and exits with 1 if any check failed
+   (make check builds and runs it).
+ */
+
+#import <Foundation/Foundation.h>
+#import <math.h>
+#import <string.h>
+
+#import "activation.h"
+#import "predict.h"
+#import "simd.h"
+
+
+// the bound of the relative error of act_exp() (the largest error on
+// the grid is 4.71e-16, i.e. a couple of ulps)
+#define CHECK_EXP_TOL 5e-16
+
+// the number of points of the grid of [-708, 708]
+#define CHECK_EXP_POINTS 14160001
+
+
+// the data and the step of the gradient check
+#define CHECK_GRAD_TPOINTS 50
+#define CHECK_GRAD_NODES 5
+#define CHECK_GRAD_STEP 1e-5
+#define CHECK_GRAD_TOL 1e-6
+#define CHECK_SEED 1
+
+
+static const char *level_names[] = {"scalar", "sse2", "avx2"};
+
+
+
+// act_exp() on the grid of [-708, 708]
+static BOOL check_exp(void) {
+
+  size_t n = CHECK_EXP_POINTS, i;
+  double *x = malloc(sizeof(double) * n);
+  double *y = malloc(sizeof(double) * n);
+  double *first = malloc(sizeof(double) * n);
+  double err, max_err, worst;
+  int level;
+  BOOL ok = YES;
+
+  for (level=SIMD_NONE; level<=simd_level(); level++) {
+    for (i=0; i<n; i++)
+      x[i] = y[i] = -708. + 1416. * i / (n - 1);
+    act_exp_path(y, n, level);
+
+    max_err = worst = 0;
+    for (i=0; i<n; i++) {
+      err = fabs(y[i] - exp(x[i])) / exp(x[i]);
+      if (err > max_err) {
+	max_err = err;
+	worst = x[i];
+      }
+    }
+    printf("exp %s : max relative error %.3g at %.17g\n",
+	   level_names[level], max_err, worst);
+    if (max_err > CHECK_EXP_TOL) {
+      printf("FAILED : the error exceeds %g\n", CHECK_EXP_TOL);
+      ok = NO;
+    }
+
+    // the SIMD paths must agree with the scalar path
+    if (level == SIMD_NONE)
+      memcpy(first, y, sizeof(double) * n);
+    else if (memcmp(first, y, sizeof(double) * n)) {
+      printf("FAILED : exp %s differs from exp scalar\n", level_names[level]);
+      ok = NO;
+    }
+  }
+
+  free(x);
+  free(y);
+  free(first);
+
+  return ok;
+
+}
+
+
+
+// the MSE of target trg and its gradient (see predict_target_grad())
+// for the parameters p : the weights, the bias term and T (DRNN only)
+static double target_grad(const gsl_matrix *X, int trg, const int *reg,
+			  int nregs, const double *p, BOOL drnn, double *grad)
+{
+
+  return predict_target_grad(X, trg, reg, p, nregs, p[nregs],
+			     drnn ? p + nregs + 1 : NULL, 1., grad);
+
+}
+
+
+
+// predict_target_grad() against central differences
+static BOOL check_grad(void) {
+
+  int reg[] = {3, 0, 4}; // a subset of the nodes (in no particular order)
+  const char *model_names[] = {"rnn", "drnn"};
+  gsl_matrix *X = gsl_matrix_alloc(CHECK_GRAD_TPOINTS, CHECK_GRAD_NODES);
+  double p[CHECK_GRAD_NODES + 2], grad[CHECK_GRAD_NODES + 2];
+  double fd, hi, lo, err, max_err, h = CHECK_GRAD_STEP;
+  int i, k, m, sub, nregs, dim;
+  BOOL ok = YES;
+
+  srand48(CHECK_SEED);
+  for (i=0; i<X->size1 * X->size2; i++)
+    X->data[i] = drand48();
+
+  for (m=0; m<2; m++)
+    for (sub=0; sub<2; sub++) {
+      nregs = sub ? sizeof(reg) / sizeof(reg[0]) : CHECK_GRAD_NODES;
+      dim = nregs + (m ? 2 : 1);
+      // random weights and bias, T in [1.5, 3]
+      for (k=0; k<nregs+1; k++)
+	p[k] = 4. * drand48() - 2.;
+      if (m)
+	p[nregs + 1] = 1.5 + 1.5 * drand48();
+
+      target_grad(X, 1, sub ? reg : NULL, nregs, p, m, grad);
+      max_err = 0;
+      for (k=0; k<dim; k++) {
+	p[k] += h;
+	hi = target_grad(X, 1, sub ? reg : NULL, nregs, p, m, NULL);
+	p[k] -= 2 * h;
+	lo = target_grad(X, 1, sub ? reg : NULL, nregs, p, m, NULL);
+	p[k] += h;
+	fd = (hi - lo) / (2 * h);
+	err = fabs(grad[k] - fd) / fmax(fabs(grad[k]) + fabs(fd), 1e-6);
+	if (err > max_err)
+	  max_err = err;
+      }
+      printf("grad %s (%s regulators) : max relative error %.3g\n",
+	     model_names[m], sub ? "some" : "all", max_err);
+      if (max_err > CHECK_GRAD_TOL) {
+	printf("FAILED : the error exceeds %g\n", CHECK_GRAD_TOL);
+	ok = NO;
+      }
+    }
+
+  gsl_matrix_free(X);
+
+  return ok;
+
+}
+
+
+
+int main(int argc, char **argv) {
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  BOOL ok = YES;
+
+  ok = check_exp() && ok;
+  ok = check_grad() && ok;
+
+  printf(ok ? "All checks passed\n" : "Some checks FAILED\n");
+
+  [pool release];
+  return ok ? 0 : 1;
+
+}
@@ -0,0 +1,53 @@
+#import  <Foundation/Foundation.h>
+#import "GSL.h"
+#import "Dynamics.h"
+#import "aco.h"
+
+
+/*
+  Checkpoints of the ACO simulation (see netinf())
+
+  A checkpoint holds the complete state of the (generational) ACO at
+  the end of a step, so that a run can continue from it (--resume)
+  exactly as it would have continued without the interruption :
+
+  ** the pheromone matrix, the global best solution (graph and errors)
+     and the lamda factors of the steps so far
+  ** the next step, the seed, the elapsed time, the state of the stop
+     criteria (see --stop_stall) and the full state of the RNG
+     (settings.rng)
+  ** the warm start parameters and the caches (if used)
+
+  A run resumes only with the settings that determine the layout of the
+  state (the nodes, the steps, the ants, the RNN type and the caches)
+  and the search trajectory (the training data, the models, the ACO and
+  PSO parameters, the training and evaluation modes and whether the
+  ants of a step run concurrently); both are saved in the checkpoint.
+
+  The state of worker processes (their caches and warm start
+  parameters) is not saved, so there are no checkpoints with
+  --workers or --remote (see netinf()).
+
+  The checkpoint is a binary file (CHECKPOINT_FILE in log_path, in the
+  byte order of the host) that is written to a temporary file and
+  then renamed, so that an interrupted write never destroys the last
+  checkpoint.
+
+  The caches are not rewritten at every checkpoint (the training cache
+  alone may hold 64 MB) : their entries are appended to journals
+  (CHECKPOINT_FILE.cache.G and CHECKPOINT_FILE.gcache.G) and the
+  checkpoint holds the length of the journals and the size of the
+  caches. A checkpoint writes and syncs only the entries added since
+  the previous one; a journal that holds twice the entries of its
+  cache is rewritten as the next generation G.
+ */
+
+
+// save the state of the ACO (step : the next step)
+// returns 0 on success
+int checkpoint_save(int step, GSLMatrix *phero, Solution *gbest,
+		    Dynamics *lamda);
+
+// restore the state of the ACO (into phero, gbest and lamda)
+// returns the next step (-1 on error)
+int checkpoint_load(GSLMatrix *phero, Solution *gbest, Dynamics *lamda);
@@ -0,0 +1,492 @@
+#import "checkpoint.h"
+#import "params.h"
+#import "RNN.h"
+
+#import <stdint.h>
+#import <string.h>
+#import <unistd.h>
+
+
+// identifies the file (and the version of its format)
+#define CHECKPOINT_MAGIC "NETINFC5"
+
+// the settings that a checkpoint must agree with
+#define CHECKPOINT_HEADER 7
+
+
+// the settings that determine the layout of the state
+static void make_header(int32_t *hdr) {
+
+  hdr[0] = settings.nodes;
+  hdr[1] = settings.aco_steps;
+  hdr[2] = settings.aco_ants;
+  hdr[3] = settings.rnn_type;
+  hdr[4] = settings.prior != nil;
+  hdr[5] = settings.cache != nil;
+  hdr[6] = settings.gcache != nil;
+
+}
+
+
+
+// a 64-bit hash (FNV-1a) of the values of the training data
+static uint64_t data_hash(void) {
+
+  const gsl_matrix *m = [settings.tdata matrix];
+  const unsigned char *p;
+  uint64_t h = 14695981039346656037ULL;
+  size_t i, k;
+
+  for (i=0; i<m->size1; i++) {
+    p = (const unsigned char *)(m->data + i * m->tda);
+    for (k=0; k<sizeof(double) * m->size2; k++)
+      h = (h ^ p[k]) * 1099511628211ULL;
+  }
+
+  return h;
+
+}
+
+
+
+// the settings that determine the search trajectory (a run continues
+// exactly as it would have only if they are the same)
+static NSString *trajectory(void) {
+
+  return [NSString stringWithFormat:
+		   @"data %d,%016llx gmodel %d edsf %d,%.17g,%.17g,%.17g,%.17g,%.17g "
+		   @"aco %.17g,%.17g,%.17g,%.17g,%.17g concurrent %d "
+		   @"decomposition %d pso %d,%d,%.17g,%.17g,%d warm %d "
+		   @"train %d,%d eval %d cache %d,%d",
+		   settings.tpoints, (unsigned long long)data_hash(),
+		   settings.gmodel, settings.edsf_start_with, settings.edsf_alpha,
+		   settings.edsf_beta, settings.edsf_gamma,
+		   settings.edsf_delta_in, settings.edsf_delta_out,
+		   settings.aco_alpha, settings.aco_beta, settings.aco_phero_val,
+		   settings.aco_rho, settings.aco_lamda, settings.ant_threads > 1,
+		   settings.decomposition, settings.pso_steps, settings.pso_stall,
+		   settings.pso_stall_tol, settings.pso_diameter,
+		   settings.pso_restart, settings.warm_start,
+		   settings.train_mode, settings.grad_steps, settings.eval_mode,
+		   settings.cache_mb, settings.graph_cache];
+
+}
+
+
+
+// all the nodes (the regulators of a dense row)
+static NSArray *all_nodes(void) {
+
+  int i;
+  NSMutableArray *all = [NSMutableArray arrayWithCapacity:settings.nodes];
+
+  for (i=0; i<settings.nodes; i++)
+    [all addObject:[NSNumber numberWithInt:i]];
+
+  return all;
+
+}
+
+
+
+//=================================================================
+//          JOURNALS OF THE CACHES
+//=================================================================
+
+// the caches are not part of the checkpoint file : each checkpoint
+// appends the entries added since the last one to the journal of the
+// cache and records its length and the number of entries of the cache
+// (the journal is rewritten, as the next generation, once it holds
+// twice the entries of the cache)
+typedef struct {
+
+  long length; // the bytes of the journal at the last checkpoint
+  int entries; // the entries in these bytes
+  unsigned long mark; // the entries added to the cache by then
+
+} journal_t;
+
+static int generation = 0; // the generation of the journals
+static journal_t journals[2]; // the training cache and the graph cache
+
+
+static NSString *journal_path(int which, int gen) {
+
+  NSString *path = [settings.log_path stringByAppendingPathComponent:CHECKPOINT_FILE];
+
+  return [path stringByAppendingFormat:which ? @".gcache.%d" : @".cache.%d", gen];
+
+}
+
+
+
+// is the journal of cache twice the size of the cache??
+static BOOL journal_full(id cache, int which) {
+
+  return cache && journals[which].entries > 2 * [cache count];
+
+}
+
+
+
+// append the new entries of cache to its journal of generation gen
+// (all the entries to a new journal if rewrite); *j receives the
+// state of the journal
+static BOOL append_journal(id cache, int which, int gen, BOOL rewrite,
+			   journal_t *j)
+{
+
+  journal_t *last = &journals[which];
+  FILE *f = fopen([journal_path(which, gen) UTF8String], rewrite ? "wb" : "ab");
+  unsigned long n;
+  BOOL ok;
+
+  if (!f)
+    return NO;
+
+  // the entries that will be written (see writeToStream:since:)
+  n = [cache added] - (rewrite ? 0 : last->mark);
+  if (n > [cache count])
+    n = [cache count];
+
+  // drop what an unfinished checkpoint might have appended
+  ok = (rewrite || ftruncate(fileno(f), last->length) == 0) &&
+    [cache writeToStream:f
+		   since:rewrite ? 0 : last->mark];
+  ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+  j->length = ftell(f);
+  j->entries = (rewrite ? 0 : last->entries) + n;
+  j->mark = [cache added];
+  ok = fclose(f) == 0 && ok;
+
+  return ok;
+
+}
+
+
+
+// add the last n entries of the journal of cache (up to length)
+static BOOL read_journal(id cache, int which, int gen, long length, int n) {
+
+  FILE *f = fopen([journal_path(which, gen) UTF8String], "rb");
+  int count;
+  BOOL ok;
+
+  if (!f)
+    return NO;
+
+  ok = [cache readFromStream:f
+		       until:length
+			last:n
+		       count:&count];
+  fclose(f);
+  if (!ok)
+    return NO;
+
+  journals[which].length = length;
+  journals[which].entries = count;
+  journals[which].mark = [cache added];
+
+  return YES;
+
+}
+
+
+
+//=================================================================
+//          SAVE
+//=================================================================
+
+static BOOL write_graph(FILE *f, Digraph *g) {
+
+  const cgraph_t *c = [g compact];
+  int32_t i, n = c->edges, pair[2];
+
+  if (fwrite(&n, sizeof(n), 1, f) != 1)
+    return NO;
+
+  for (i=0; i<n; i++) {
+    pair[0] = c->in[i];
+    pair[1] = c->trg[i];
+    if (fwrite(pair, sizeof(int32_t), 2, f) != 2)
+      return NO;
+  }
+
+  return YES;
+
+}
+
+
+
+static BOOL write_prior(FILE *f) {
+
+  NSArray *all = all_nodes();
+  GSLVector *v;
+  int32_t len;
+  int trg;
+
+  if (gsl_vector_fwrite(f, [settings.prior_errors vec]))
+    return NO;
+
+  // the parameters of each target (dense rows)
+  for (trg=0; trg<settings.nodes; trg++) {
+    v = [settings.prior vectorForNode:trg
+		       withRegulators:all];
+    len = [v count];
+    if (fwrite(&len, sizeof(len), 1, f) != 1 ||
+	gsl_vector_fwrite(f, [v vec]))
+      return NO;
+  }
+
+  return YES;
+
+}
+
+
+
+int checkpoint_save(int step, GSLMatrix *phero, Solution *gbest,
+		    Dynamics *lamda)
+{
+
+  NSString *path = [settings.log_path stringByAppendingPathComponent:CHECKPOINT_FILE];
+  NSString *tmp = [path stringByAppendingPathExtension:@"tmp"];
+  FILE *f = fopen([tmp UTF8String], "wb");
+  const char *rng_name = gsl_rng_name([settings.rng rng]);
+  const char *traj = [trajectory() UTF8String];
+  int32_t hdr[CHECKPOINT_HEADER], next = step, len = strlen(rng_name);
+  int32_t traj_len = strlen(traj);
+  uint64_t seed = settings.seed;
+  double elapsed = -[settings.start timeIntervalSinceNow];
+  int stall_step, i;
+  double stall_error;
+  int32_t stall;
+  // the journals of the caches
+  BOOL rewrite = journal_full(settings.cache, 0) || journal_full(settings.gcache, 1);
+  int32_t gen = rewrite ? generation + 1 : generation, count[2];
+  int64_t length[2];
+  journal_t next_journals[2] = {journals[0], journals[1]};
+  BOOL ok;
+
+  if (!f)
+    return -1;
+
+  make_header(hdr);
+  get_stall_state(&stall_step, &stall_error);
+  stall = stall_step;
+
+  // the new entries of the caches go to the journals first
+  ok = (!settings.cache ||
+	append_journal(settings.cache, 0, gen, rewrite, &next_journals[0])) &&
+    (!settings.gcache ||
+     append_journal(settings.gcache, 1, gen, rewrite, &next_journals[1]));
+  for (i=0; i<2; i++)
+    length[i] = next_journals[i].length;
+  count[0] = settings.cache ? [settings.cache count] : 0;
+  count[1] = settings.gcache ? [settings.gcache count] : 0;
+
+  ok = ok && fwrite(CHECKPOINT_MAGIC, 1, 8, f) == 8 &&
+    fwrite(hdr, sizeof(int32_t), CHECKPOINT_HEADER, f) == CHECKPOINT_HEADER &&
+    fwrite(&traj_len, sizeof(traj_len), 1, f) == 1 &&
+    fwrite(traj, 1, traj_len, f) == traj_len &&
+    fwrite(&next, sizeof(next), 1, f) == 1 &&
+    fwrite(&seed, sizeof(seed), 1, f) == 1 &&
+    fwrite(&elapsed, sizeof(elapsed), 1, f) == 1 &&
+    // the stop criteria
+    fwrite(&stall, sizeof(stall), 1, f) == 1 &&
+    fwrite(&stall_error, sizeof(stall_error), 1, f) == 1 &&
+    // the RNG (type and state)
+    fwrite(&len, sizeof(len), 1, f) == 1 &&
+    fwrite(rng_name, 1, len, f) == len &&
+    gsl_rng_fwrite(f, [settings.rng rng]) == 0 &&
+    // the ACO
+    gsl_matrix_fwrite(f, [phero matrix]) == 0 &&
+    gsl_matrix_fwrite(f, [lamda matrix]) == 0 &&
+    gsl_vector_fwrite(f, [[gbest errors] vec]) == 0 &&
+    write_graph(f, [gbest graph]) &&
+    // the shared state of the evaluations
+    (!settings.prior || write_prior(f)) &&
+    // the journals (generation, lengths and the entries of the caches)
+    fwrite(&gen, sizeof(gen), 1, f) == 1 &&
+    fwrite(length, sizeof(int64_t), 2, f) == 2 &&
+    fwrite(count, sizeof(int32_t), 2, f) == 2;
+
+  // make sure that the data are on disk before replacing the last checkpoint
+  ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+  ok = fclose(f) == 0 && ok;
+  if (ok)
+    ok = rename([tmp UTF8String], [path UTF8String]) == 0;
+  if (!ok)
+    unlink([tmp UTF8String]);
+
+  // the checkpoint now refers to the new journals (or still to the old)
+  for (i=0; rewrite && i<2; i++)
+    unlink([journal_path(i, ok ? generation : gen) UTF8String]);
+  if (ok) {
+    generation = gen;
+    journals[0] = next_journals[0];
+    journals[1] = next_journals[1];
+  }
+
+  return ok ? 0 : -1;
+
+}
+
+
+
+//=================================================================
+//          LOAD
+//=================================================================
+
+static BOOL read_graph(FILE *f, Solution *gbest, GSLVector *errors) {
+
+  Digraph *g = [Digraph digraphWithNodes:settings.nodes];
+  int32_t i, n, pair[2];
+
+  if (fread(&n, sizeof(n), 1, f) != 1 || n < 0)
+    return NO;
+
+  for (i=0; i<n; i++) {
+    if (fread(pair, sizeof(int32_t), 2, f) != 2 ||
+	pair[0] < 0 || pair[0] >= settings.nodes ||
+	pair[1] < 0 || pair[1] >= settings.nodes)
+      return NO;
+    [g addEdgeFrom:[NSNumber numberWithInt:pair[0]]
+		To:[NSNumber numberWithInt:pair[1]]];
+  }
+
+  // gbest becomes the saved solution
+  [gbest clear];
+  [gbest updateWith:[[[Solution alloc] initWithGraph:g
+					   andErrors:errors]
+		      autorelease]];
+
+  return YES;
+
+}
+
+
+
+static BOOL read_prior(FILE *f) {
+
+  NSArray *all = all_nodes();
+  GSLVector *v;
+  int32_t len;
+  int trg;
+
+  if (gsl_vector_fread(f, (gsl_vector *)[settings.prior_errors vec]))
+    return NO;
+
+  for (trg=0; trg<settings.nodes; trg++) {
+    if (fread(&len, sizeof(len), 1, f) != 1 || len <= 0)
+      return NO;
+    v = [GSLVector vectorWithSize:len];
+    if (gsl_vector_fread(f, (gsl_vector *)[v vec]))
+      return NO;
+    [settings.prior setFromVector:v
+			  forNode:trg];
+  }
+
+  return YES;
+
+}
+
+
+
+int checkpoint_load(GSLMatrix *phero, Solution *gbest, Dynamics *lamda) {
+
+  NSString *path = [settings.log_path stringByAppendingPathComponent:CHECKPOINT_FILE];
+  FILE *f = fopen([path UTF8String], "rb");
+  const char *rng_name = gsl_rng_name([settings.rng rng]);
+  const char *traj = [trajectory() UTF8String];
+  char magic[8], name[256], saved_traj[1024];
+  int32_t hdr[CHECKPOINT_HEADER], saved[CHECKPOINT_HEADER], next, len, stall;
+  int32_t traj_len;
+  uint64_t seed;
+  double elapsed, stall_error;
+  int32_t gen, count[2];
+  int64_t length[2];
+  GSLVector *errors = [GSLVector vectorWithSize:settings.nodes];
+  BOOL ok;
+
+  if (!f) {
+    fprintf(stderr, "Checkpoint %s does not exist\n", [path UTF8String]);
+    return -1;
+  }
+
+  make_header(hdr);
+
+  ok = fread(magic, 1, 8, f) == 8 &&
+    memcmp(magic, CHECKPOINT_MAGIC, 8) == 0 &&
+    fread(saved, sizeof(int32_t), CHECKPOINT_HEADER, f) == CHECKPOINT_HEADER &&
+    memcmp(saved, hdr, sizeof(hdr)) == 0 &&
+    fread(&traj_len, sizeof(traj_len), 1, f) == 1 &&
+    traj_len >= 0 && traj_len < sizeof(saved_traj) &&
+    fread(saved_traj, 1, traj_len, f) == traj_len &&
+    fread(&next, sizeof(next), 1, f) == 1 &&
+    next >= 0 && next <= settings.aco_steps &&
+    fread(&seed, sizeof(seed), 1, f) == 1 &&
+    fread(&elapsed, sizeof(elapsed), 1, f) == 1 &&
+    fread(&stall, sizeof(stall), 1, f) == 1 &&
+    stall < next &&
+    fread(&stall_error, sizeof(stall_error), 1, f) == 1 &&
+    fread(&len, sizeof(len), 1, f) == 1 &&
+    len >= 0 && len < sizeof(name) &&
+    fread(name, 1, len, f) == len;
+
+  if (!ok) {
+    fprintf(stderr, "Checkpoint %s does not match the settings\n", [path UTF8String]);
+    fclose(f);
+    return -1;
+  }
+
+  // the search must continue with the same settings
+  saved_traj[traj_len] = '\0';
+  if (strcmp(saved_traj, traj)) {
+    fprintf(stderr, "Checkpoint settings\n  %s\ndo not match the settings\n  %s\n",
+	    saved_traj, traj);
+    fclose(f);
+    return -1;
+  }
+
+  // the RNG must be of the same type
+  name[len] = '\0';
+  if (strcmp(name, rng_name)) {
+    fprintf(stderr, "Checkpoint RNG %s does not match the RNG %s\n", name, rng_name);
+    fclose(f);
+    return -1;
+  }
+
+  ok = gsl_rng_fread(f, [settings.rng rng]) == 0 &&
+    gsl_matrix_fread(f, (gsl_matrix *)[phero matrix]) == 0 &&
+    gsl_matrix_fread(f, (gsl_matrix *)[lamda matrix]) == 0 &&
+    gsl_vector_fread(f, (gsl_vector *)[errors vec]) == 0 &&
+    read_graph(f, gbest, errors) &&
+    (!settings.prior || read_prior(f)) &&
+    fread(&gen, sizeof(gen), 1, f) == 1 &&
+    fread(length, sizeof(int64_t), 2, f) == 2 &&
+    fread(count, sizeof(int32_t), 2, f) == 2;
+  fclose(f);
+
+  // the caches
+  ok = ok &&
+    (!settings.cache || read_journal(settings.cache, 0, gen, length[0], count[0])) &&
+    (!settings.gcache || read_journal(settings.gcache, 1, gen, length[1], count[1]));
+  if (ok)
+    generation = gen;
+
+  if (!ok) {
+    fprintf(stderr, "Checkpoint %s is corrupt\n", [path UTF8String]);
+    return -1;
+  }
+
+  // the ants' RNG streams derive from the seed
+  settings.seed = seed;
+  // the duration includes the time before the checkpoint
+  [settings.start release];
+  settings.start = [[NSDate alloc] initWithTimeIntervalSinceNow:-elapsed];
+  // the stop criteria continue from the saved step
+  set_stall_state(stall, stall_error);
+
+  return next;
+
+}
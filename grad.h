@@ -0,0 +1,57 @@
+/* Gradient-based local minimization (a thin layer over GSL's multimin)
+
+   Used for refining the PSO solution (gbest) of the RNN training
+   problems, whose objective functions have an analytic gradient
+   (see predict_target_grad() in predict.h).
+ */
+
+#ifndef GRAD_H_
+#define GRAD_H_
+
+#include <stddef.h>
+
+
+// === MINIMIZATION METHODS ===
+
+// quasi-Newton (BFGS, gsl_multimin_fdfminimizer_vector_bfgs2)
+#define GRAD_BFGS 0
+
+// conjugate gradient (Polak-Ribiere)
+#define GRAD_CG_PR 1
+
+// conjugate gradient (Fletcher-Reeves)
+#define GRAD_CG_FR 2
+
+
+
+// OBJECTIVE FUNCTION
+// returns the value at x and stores the gradient in grad
+// (grad may be NULL, in which case only the value is needed)
+typedef double (*grad_obj_fun_t)(const double *x, size_t dim,
+				 double *grad, void *params);
+
+
+// MINIMIZATION SETTINGS
+typedef struct {
+
+    int method; // the minimization method (see above)
+    int steps; // max number of iterations
+    double step_size; // the size of the first trial step
+    double tol; // the accuracy of the line minimizations
+    double epsabs; // stop when the norm of the gradient drops below it
+
+} grad_settings_t;
+
+
+// set the default settings
+void grad_set_default_settings(grad_settings_t *settings);
+
+// minimize fun starting from x (dim elements)
+// x receives the best position, which is never worse than the
+// starting position; returns the value of fun at x
+// (x is kept if the value or the gradient at x is not finite)
+double grad_minimize(grad_obj_fun_t fun, void *params, double *x,
+		     size_t dim, grad_settings_t *settings);
+
+
+#endif // GRAD_H_
@@ -0,0 +1,143 @@
+/* Gradient-based local minimization -- see grad.h */
+
+#include "grad.h"
+
+#include <gsl/gsl_errno.h> // for GSL_SUCCESS
+#include <gsl/gsl_math.h> // for gsl_finite()
+#include <gsl/gsl_multimin.h>
+#include <stdlib.h> // for malloc()
+#include <string.h> // for memcpy()
+
+
+// the objective function and its parameters (as GSL params)
+typedef struct {
+
+    grad_obj_fun_t fun;
+    void *params;
+
+} grad_obj_t;
+
+
+
+//==============================================================
+//                  GSL FUNCTION WRAPPERS
+//==============================================================
+
+static double grad_f(const gsl_vector *x, void *params) {
+
+    grad_obj_t *obj = params;
+
+    return obj->fun(x->data, x->size, NULL, obj->params);
+
+}
+
+
+static void grad_fdf(const gsl_vector *x, void *params,
+		     double *f, gsl_vector *g)
+{
+
+    grad_obj_t *obj = params;
+
+    *f = obj->fun(x->data, x->size, g->data, obj->params);
+
+}
+
+
+static void grad_df(const gsl_vector *x, void *params, gsl_vector *g) {
+
+    double f;
+
+    grad_fdf(x, params, &f, g);
+
+}
+
+
+
+//==============================================================
+//                     MINIMIZATION
+//==============================================================
+
+void grad_set_default_settings(grad_settings_t *settings) {
+
+    settings->method = GRAD_BFGS;
+    settings->steps = 100;
+    settings->step_size = 0.01;
+    settings->tol = 0.1;
+    settings->epsabs = 1e-8;
+
+}
+
+
+
+double grad_minimize(grad_obj_fun_t fun, void *params, double *x,
+		     size_t dim, grad_settings_t *settings)
+{
+
+    const gsl_multimin_fdfminimizer_type *type;
+    gsl_multimin_fdfminimizer *s;
+    gsl_multimin_function_fdf fdf;
+    grad_obj_t obj = {fun, params};
+    gsl_vector_view x0;
+    double f0, f, *g0;
+    int step, status;
+    size_t i;
+    int finite;
+
+    // value at the starting position
+    if (dim == 0 || settings->steps <= 0)
+	return fun(x, dim, NULL, params);
+
+    // the minimizers need a finite value and gradient to start from
+    // (otherwise the starting position is kept)
+    g0 = malloc(sizeof(double) * dim);
+    f0 = fun(x, dim, g0, params);
+    finite = gsl_finite(f0);
+    for (i=0; finite && i<dim; i++)
+	finite = gsl_finite(g0[i]);
+    free(g0);
+    if (!finite)
+	return f0;
+
+    switch (settings->method) {
+    case GRAD_CG_PR:
+	type = gsl_multimin_fdfminimizer_conjugate_pr;
+	break;
+    case GRAD_CG_FR:
+	type = gsl_multimin_fdfminimizer_conjugate_fr;
+	break;
+    default:
+	type = gsl_multimin_fdfminimizer_vector_bfgs2;
+    }
+
+    x0 = gsl_vector_view_array(x, dim);
+    fdf.n = dim;
+    fdf.f = grad_f;
+    fdf.df = grad_df;
+    fdf.fdf = grad_fdf;
+    fdf.params = &obj;
+
+    s = gsl_multimin_fdfminimizer_alloc(type, dim);
+    gsl_multimin_fdfminimizer_set(s, &fdf, &x0.vector,
+				  settings->step_size, settings->tol);
+
+    for (step=0; step<settings->steps; step++) {
+	// no progress (or a non-finite value) stops the iterations
+	if (gsl_multimin_fdfminimizer_iterate(s))
+	    break;
+	status = gsl_multimin_test_gradient(s->gradient, settings->epsabs);
+	if (status == GSL_SUCCESS)
+	    break;
+    }
+
+    // keep the minimizer's position only if it is an improvement
+    f = gsl_multimin_fdfminimizer_minimum(s);
+    if (gsl_finite(f) && f < f0)
+	memcpy(x, gsl_multimin_fdfminimizer_x(s)->data, sizeof(double) * dim);
+    else
+	f = f0;
+
+    gsl_multimin_fdfminimizer_free(s);
+
+    return f;
+
+}
@@ -8,9 +8,65 @@
 // double pso_obj_fun(double *vec, size_t dim);
 
 
+// prepare the generation of graphs from phero (the edge probabilities
+// of the PHERO model); call it whenever phero changes -- the graphs are
+// generated from the prepared probabilities until the next call
+// (not thread-safe; no graph may be generated concurrently)
+void prepare_graphs(GSLMatrix *phero);
+
 // graphs generation function
 Digraph *generate_graph(GSLMatrix *phero);
 
 // graph evaluation function (using PSO)
-GSLVector *evaluate_graph(Digraph *g);
+// evals receives the number of PSO objective evaluations (could be NULL)
+GSLVector *evaluate_graph(Digraph *g, long *evals);
+
+
+
+//***********************************************************************
+//***********************************************************************
+
+@class RNN;
+
+/*
+  EvalUpdates : the updates of the shared state (the training cache
+  and the warm start parameters) made by graph evaluations
+
+  A thread that owns an EvalUpdates object (see set_thread_updates())
+  does not modify the shared state; its updates are recorded and
+  applied later by the owner of the shared state (see aco.m), so that
+  concurrent evaluations neither race nor depend on each other.
+ */
+
+@interface EvalUpdates : NSObject {
+
+  NSMutableArray *keys; // the keys of the cached trainings
+  NSMutableArray *params; // the parameters of the cached trainings
+  NSMutableArray *errors; // the errors of the cached trainings
+  NSMutableArray *rnns; // the trained RNNs (for settings.prior)
+  NSMutableArray *rnnErrors; // the per-target errors of rnns
+
+}
+
+- (id) init;
+- (void) dealloc;
+
+// record a training for the cache
+- (void) cacheParams:(GSLVector *)p
+	       error:(double)err
+	      forKey:(NSString *)key;
+
+// record a trained RNN for the warm start parameters
+- (void) priorFrom:(RNN *)rnn
+	withErrors:(GSLVector *)v;
+
+// apply the updates (in the order they were recorded)
+- (void) apply;
+
+@end
+
+
+// set the updates of the calling thread
+// (nil : the updates are applied immediately)
+void set_thread_updates(EvalUpdates *updates);
 
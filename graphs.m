@@ -2,10 +2,16 @@
 #import "params.h"
 
 #import "pso.h"
+#import "grad.h"
 
 #import "RNN.h"
 #import "Dynamics.h"
 #import "common.h"
+#import "cache.h"
+
+#import <pthread.h>
+#import <math.h>
+#import <string.h>
 
 
 
@@ -15,178 +21,362 @@
 //=================================================================
 
 
+// ====================================
+// ===== PREPARED PHERO QUANTITIES =====
+// ====================================
+
+// the number of buckets of the PHERO model (see below; the last
+// bucket holds all smaller probabilities)
+#define PHERO_BUCKETS 32
+
+// the quantities of the graph models that depend only on phero
+// (and the settings), prepared once per step (see prepare_graphs())
+static struct {
+  int n; // the number of nodes
+  // PHERO model
+  int *regs; // the (non-zero) regulators of each target (n per target)
+  double *probs; // their probabilities
+  int *start; // the buckets of each target (PHERO_BUCKETS + 1 per target)
+  // EDSF model
+  double *out_s; // the stigmergic components of the regulators
+  double *in_s; // the stigmergic components of the targets
+  double *out_h; // the heuristic component of each out-degree (0..n)
+  double *in_h; // the heuristic component of each in-degree (0..n)
+  NSArray *nodes; // the node objects (no boxing when adding edges)
+} prepared = {0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, nil};
+
+
+void prepare_graphs(GSLMatrix *phero) {
+
+  const gsl_matrix *m = [phero matrix];
+  int n = m->size1, reg, trg, k, e;
+  int count[PHERO_BUCKETS + 1], *start;
+  int bucket[n];
+  double sum, p;
+  NSMutableArray *nodes;
+
+  // (re)allocate
+  if (prepared.n != n) {
+    free(prepared.regs);
+    free(prepared.probs);
+    free(prepared.start);
+    free(prepared.out_s);
+    free(prepared.in_s);
+    free(prepared.out_h);
+    free(prepared.in_h);
+    [prepared.nodes release];
+    prepared.regs = malloc(sizeof(int) * n * n);
+    prepared.probs = malloc(sizeof(double) * n * n);
+    prepared.start = malloc(sizeof(int) * n * (PHERO_BUCKETS + 1));
+    prepared.out_s = malloc(sizeof(double) * n);
+    prepared.in_s = malloc(sizeof(double) * n);
+    prepared.out_h = malloc(sizeof(double) * (n + 1));
+    prepared.in_h = malloc(sizeof(double) * (n + 1));
+    nodes = [[NSMutableArray alloc] initWithCapacity:n];
+    for (reg=0; reg<n; reg++)
+      [nodes addObject:[NSNumber numberWithInt:reg]];
+    prepared.nodes = nodes;
+    prepared.n = n;
+  }
+
+  // EDSF :: the outgoing and incoming phero of each node
+  for (reg=0; reg<n; reg++) {
+    sum = 0;
+    for (trg=0; trg<n; trg++)
+      sum += gsl_matrix_get(m, reg, trg);
+    prepared.out_s[reg] = pow(sum, settings.aco_beta);
+  }
+  for (e=0; e<=n; e++) {
+    prepared.out_h[e] = pow(settings.edsf_delta_out + e, settings.aco_alpha);
+    prepared.in_h[e] = pow(settings.edsf_delta_in + e, settings.aco_alpha);
+  }
+
+  for (trg=0; trg<n; trg++) {
+    start = prepared.start + trg * (PHERO_BUCKETS + 1);
+    // calculate phero.sum(axis=0)
+    sum = 0;
+    for (reg=0; reg<n; reg++)
+      sum += gsl_matrix_get(m, reg, trg);
+    prepared.in_s[trg] = pow(sum, settings.aco_beta);
+    // PHERO :: the bucket of each regulator (-1 : never an edge)
+    memset(count, 0, sizeof(count));
+    for (reg=0; reg<n; reg++) {
+      p = sum > 0 ? gsl_matrix_get(m, reg, trg) / sum : 0;
+      if (p > 0) {
+	// p = f * 2^e with f in [0.5,1) => p in (2^-(k+1), 2^-k]
+	p = frexp(p, &e);
+	k = (p == 0.5) ? 1 - e : -e;
+	bucket[reg] = k < 0 ? 0 : (k < PHERO_BUCKETS ? k : PHERO_BUCKETS - 1);
+	count[bucket[reg] + 1] += 1;
+      } else
+	bucket[reg] = -1;
+    }
+    // the offsets of the buckets (counting sort)
+    for (k=0; k<PHERO_BUCKETS; k++)
+      count[k+1] += count[k];
+    memcpy(start, count, sizeof(count));
+    for (reg=0; reg<n; reg++)
+      if (bucket[reg] >= 0) {
+	e = trg * n + count[bucket[reg]]++;
+	prepared.regs[e] = reg;
+	prepared.probs[e] = gsl_matrix_get(m, reg, trg) / sum;
+      }
+  }
+
+}
+
+
+
 // ====================================
 // =========== EDSF MODEL =============
 // ====================================
 
-// returns an index from POOL array
-int edsf_choose_node(GSLVector *pheros, GSLVector *degrees, double delta)
-{
-  int len = [pheros count];
+// The nodes are chosen with probabilities proportional to the
+// product of a heuristic (degree) and a stigmergic (phero) component.
+// The weights of the candidates of each choice are kept in Fenwick
+// trees (a node's weight is zero while it is not a candidate), so that
+// a choice and the update of a weight cost O(log n).
+
+// a Fenwick (binary indexed) tree of non-negative weights
+typedef struct {
+  int n;
+  double *tree; // the partial sums (1-based)
+  double *w; // the weights
+} fenwick_t;
+
+
+static void fenwick_init(fenwick_t *f, int n) {
+
+  f->n = n;
+  f->tree = calloc(n + 1, sizeof(double));
+  f->w = calloc(n, sizeof(double));
+
+}
+
+
+static void fenwick_free(fenwick_t *f) {
 
-  // calculate heuristic component
-  GSLVector *probs = [GSLVector vectorWithSize:len];
+  free(f->tree);
+  free(f->w);
+
+}
+
+
+static void fenwick_set(fenwick_t *f, int i, double w) {
+
+  double d = w - f->w[i];
+
+  f->w[i] = w;
+  for (i++; i<=f->n; i+=i&-i)
+    f->tree[i] += d;
+
+}
+
+
+static double fenwick_sum(fenwick_t *f) {
+
+  double s = 0;
   int i;
-  double H, S;
 
-  for (i=0; i<len; i++) {
-    // calculate heuristic component
-    if (degrees)
-      H = pow(delta + [degrees valueAtIndex:i], 
-	      settings.aco_alpha);
-    else
-      H = delta;
+  for (i=f->n; i>0; i-=i&-i)
+    s += f->tree[i];
 
-    // calculate stigmergic component
-    S = pow([pheros valueAtIndex:i], settings.aco_beta);
+  return s;
 
-    // update value of probs
-    [probs setValue:H * S
-	    atIndex:i];
+}
+
+
+// choose an index with probability proportional to its weight
+// (-1 if all weights are zero)
+static int fenwick_choose(fenwick_t *f, gsl_rng *rng) {
+
+  double r = gsl_rng_uniform(rng) * fenwick_sum(f);
+  int i = 0, step;
+
+  // the largest prefix whose sum does not exceed r
+  for (step=1; step*2<=f->n; step*=2)
+    ;
+  for (; step>0; step/=2)
+    if (i + step <= f->n && f->tree[i + step] <= r) {
+      i += step;
+      r -= f->tree[i];
+    }
+
+  // rounding could land past the end or on a zero weight
+  if (i >= f->n)
+    i = f->n - 1;
+  for (step=i; step>=0 && f->w[step]<=0; step--)
+    ;
+  if (step >= 0)
+    return step;
+  for (step=i+1; step<f->n && f->w[step]<=0; step++)
+    ;
+
+  return step < f->n ? step : -1;
 
-  }
-    
-  // normalize probs
-  [probs divideByValue:[probs sum]];
-  // run roulette and return node object
-  return gsl_roulette(probs, settings.rng);
-    
 }
 
 
 
-GSLVector *edsf_get_degrees(NSArray *pool, Digraph *graph, BOOL indeg) {
+// the state of a graph under construction
+typedef struct {
+  int n;
+  int *nc; // the unconnected nodes
+  int *pos; // the position of each node in nc (-1 : connected)
+  int n_nc; // the number of unconnected nodes
+  int *c; // the connected nodes
+  int n_c; // the number of connected nodes
+  int *outdeg, *indeg; // the degrees of the nodes
+  fenwick_t new_reg; // unconnected nodes as regulators
+  fenwick_t new_trg; // unconnected nodes as targets
+  fenwick_t old_reg; // connected nodes as regulators
+  fenwick_t old_trg; // connected nodes as targets
+} edsf_t;
 
-  int i, deg, len = [pool count];
-  GSLVector *vec = [GSLVector vectorWithSize:len];
-  for (i=0; i<len; i++) {
-    if (indeg)
-      deg = [graph inDegreeOfNode:[NSNumber numberWithInt:i]];
-    else
-      deg = [graph outDegreeOfNode:[NSNumber numberWithInt:i]];
 
-    [vec setValue:deg
-	  atIndex:i];
-  }
+// the weights of a connected node
+static void edsf_update(edsf_t *s, int node) {
+
+  fenwick_set(&s->old_reg, node,
+	      prepared.out_h[s->outdeg[node]] * prepared.out_s[node]);
+  fenwick_set(&s->old_trg, node,
+	      prepared.in_h[s->indeg[node]] * prepared.in_s[node]);
+
+}
+
+
+// an unconnected node becomes connected
+static void edsf_connect(edsf_t *s, int node) {
+
+  int last = s->nc[--s->n_nc];
+
+  // remove it from nc
+  s->nc[s->pos[node]] = last;
+  s->pos[last] = s->pos[node];
+  s->pos[node] = -1;
+  fenwick_set(&s->new_reg, node, 0);
+  fenwick_set(&s->new_trg, node, 0);
+  // and add it to c
+  s->c[s->n_c++] = node;
+  edsf_update(s, node);
+
+}
+
+
+// choose a node from f (uniformly from pool if all weights are zero)
+static int edsf_choose(fenwick_t *f, int *pool, int len, gsl_rng *rng) {
+
+  int node = fenwick_choose(f, rng);
+
+  return node >= 0 ? node : pool[gsl_rng_uniform_int(rng, len)];
 
-  return vec;
 }
 
 
 Digraph *edsf_model(GSLMatrix *phero) {
 
-  int i;
-  int ireg, itrg; // pool indices
-  NSNumber * reg, *trg; // storage of nodes
+  int i, n, reg, trg, rule, edges;
+  edsf_t s;
+  gsl_rng *rng = [current_rng() rng];
+  double rules[3] = {settings.edsf_alpha, settings.edsf_beta, settings.edsf_gamma};
+  double r;
 
-  // form pool of unconnected nodes
-  NSMutableArray *pool_nc = [[NSMutableArray alloc] 
-				  initWithCapacity:settings.nodes];
-  // populate pool (all nodes are initially unconnected)
-  for (i=0; i<settings.nodes; i++)
-    [pool_nc addObject:[NSNumber numberWithInt:i]];
-    
-  // form pool of connected nodes (initially empty)
-  NSMutableArray *pool_c = [[NSMutableArray alloc] 
-				  initWithCapacity:settings.nodes];
+  if (prepared.n == 0)
+    prepare_graphs(phero);
+  n = prepared.n;
 
   // initialize graph
-  Digraph *graph = [Digraph digraphWithNodes:settings.nodes];
+  Digraph *graph = [Digraph digraphWithNodes:n];
+
+  // all nodes are initially unconnected
+  s.n = n;
+  s.nc = malloc(sizeof(int) * n);
+  s.pos = malloc(sizeof(int) * n);
+  s.c = malloc(sizeof(int) * n);
+  s.outdeg = calloc(n, sizeof(int));
+  s.indeg = calloc(n, sizeof(int));
+  s.n_nc = n;
+  s.n_c = 0;
+  fenwick_init(&s.new_reg, n);
+  fenwick_init(&s.new_trg, n);
+  fenwick_init(&s.old_reg, n);
+  fenwick_init(&s.old_trg, n);
+  for (i=0; i<n; i++) {
+    s.nc[i] = i;
+    s.pos[i] = i;
+    fenwick_set(&s.new_reg, i, prepared.out_s[i]);
+    fenwick_set(&s.new_trg, i, prepared.in_s[i]);
+  }
 
   // add a few initial edges to the graph
-  for (i=0; i<settings.edsf_start_with; i++) {
+  for (i=0; i<settings.edsf_start_with && s.n_nc>=2; i++) {
     // choose a new reg node
-    ireg = edsf_choose_node([[phero sumAcrossColumns] take:pool_nc],
-			    nil,
-			    1);
-    reg = [pool_nc objectAtIndex:ireg];
-    [pool_c addObject:[pool_nc popAtIndex:ireg]];
-
+    reg = edsf_choose(&s.new_reg, s.nc, s.n_nc, rng);
+    edsf_connect(&s, reg);
     // choose a new target node
-    itrg = edsf_choose_node([[phero sumAcrossRows] take:pool_nc],
-			    nil,
-			    1);
-    trg = [pool_nc objectAtIndex:itrg];
-    [pool_c addObject:[pool_nc popAtIndex:itrg]];
-
+    trg = edsf_choose(&s.new_trg, s.nc, s.n_nc, rng);
+    edsf_connect(&s, trg);
     // add edge to the graph under construction
-    [graph addEdgeFrom:reg
-		    To:trg];
+    [graph addEdgeFrom:[prepared.nodes objectAtIndex:reg]
+		    To:[prepared.nodes objectAtIndex:trg]];
+    s.outdeg[reg] += 1;
+    s.indeg[trg] += 1;
+    edsf_update(&s, reg);
+    edsf_update(&s, trg);
   }
 
-  // setup vector of rule probabilities
-  GSLVector *rules = [[GSLVector alloc] initWithSize:3];
-  [rules setValue:settings.edsf_alpha
-	  atIndex:0];
-  [rules setValue:settings.edsf_beta
-	  atIndex:1];
-  [rules setValue:settings.edsf_gamma
-	  atIndex:2];
-
-  int rule;
-
   // as long as there exist unconnected nodes
-  while ([pool_nc count]) {
+  while (s.n_nc) {
 
     // pick a rule to apply
-    rule = gsl_roulette(rules, settings.rng);
+    r = gsl_rng_uniform(rng) * (rules[0] + rules[1] + rules[2]);
+    rule = r < rules[0] ? 0 : (r < rules[0] + rules[1] ? 1 : 2);
 
-    if (rule == 0) {
+    if (rule == 0 && s.n_c > 0) {
       // choose a new reg acc to phero values of outgoing edges
-      ireg = edsf_choose_node([[phero sumAcrossColumns] take:pool_nc],
-			      nil,
-			      1);
-      reg = [pool_nc objectAtIndex:ireg];
+      reg = edsf_choose(&s.new_reg, s.nc, s.n_nc, rng);
       // choose an existing trg acc to in-degrees and incoming phero
-      itrg = edsf_choose_node([[phero sumAcrossRows] take:pool_c],
-			      edsf_get_degrees(pool_c, graph, YES),
-			      settings.edsf_delta_in);
-      trg = [pool_c objectAtIndex:itrg];
-
-      // remove new reg from pool_nc and add it to pool_c
-      [pool_c addObject:[pool_nc popAtIndex:ireg]];
-
-    } else if (rule == 1) {
-
+      trg = edsf_choose(&s.old_trg, s.c, s.n_c, rng);
+      // the new reg is connected now
+      edsf_connect(&s, reg);
+    } else if (rule == 1 && s.n_c > 0) {
       // choose existing reg acc to out-degress and outgoing phero
-      ireg = edsf_choose_node([[phero sumAcrossColumns] take:pool_c],
-			      edsf_get_degrees(pool_c, graph, NO),
-			      settings.edsf_delta_out);
-      reg = [pool_c objectAtIndex:ireg];
+      reg = edsf_choose(&s.old_reg, s.c, s.n_c, rng);
       // choose an existing trg acc to in-degrees and incoming phero
-      itrg = edsf_choose_node([[phero sumAcrossRows] take:pool_c],
-			      edsf_get_degrees(pool_c, graph, YES),
-			      settings.edsf_delta_in);
-      trg = [pool_c objectAtIndex:itrg];
-
-    } else {
-
+      trg = edsf_choose(&s.old_trg, s.c, s.n_c, rng);
+    } else if (s.n_c > 0) {
       // choose existing reg acc to out-degress and outgoing phero
-      ireg = edsf_choose_node([[phero sumAcrossColumns] take:pool_c],
-			      edsf_get_degrees(pool_c, graph, NO),
-			      settings.edsf_delta_out);
-      reg = [pool_c objectAtIndex:ireg];
-
+      reg = edsf_choose(&s.old_reg, s.c, s.n_c, rng);
       // choose new trg acc to incoming phero
-      itrg = edsf_choose_node([[phero sumAcrossRows] take:pool_nc],
-			      nil,
-			      1);
-      trg = [pool_nc objectAtIndex:itrg];
-
-      // remove new trg from pool_nc and add it to pool_c
-      [pool_c addObject:[pool_nc popAtIndex:itrg]];
-
+      trg = edsf_choose(&s.new_trg, s.nc, s.n_nc, rng);
+      // the new trg is connected now
+      edsf_connect(&s, trg);
+    } else
+      // no connected nodes (edsf_start_with is 0)
+      break;
+
+    // add the new edge to the graph (and update the degrees)
+    edges = [graph countEdges];
+    [graph addEdgeFrom:[prepared.nodes objectAtIndex:reg]
+		    To:[prepared.nodes objectAtIndex:trg]];
+    if ([graph countEdges] > edges) {
+      s.outdeg[reg] += 1;
+      s.indeg[trg] += 1;
+      edsf_update(&s, reg);
+      edsf_update(&s, trg);
     }
-
-    // add the new edge to the graph
-    [graph addEdgeFrom:reg
-		    To:trg];
   }
 
-  // release arrays
-  [pool_nc release];
-  [pool_c release];
-  [rules release];
+  // release the state
+  free(s.nc);
+  free(s.pos);
+  free(s.c);
+  free(s.outdeg);
+  free(s.indeg);
+  fenwick_free(&s.new_reg);
+  fenwick_free(&s.new_trg);
+  fenwick_free(&s.old_reg);
+  fenwick_free(&s.old_trg);
 
   return graph;
 }
@@ -194,24 +384,58 @@ Digraph *edsf_model(GSLMatrix *phero) {
 // =====================================
 // =========== PHERO MODEL =============
 // =====================================
+
+// The probability of edge (reg,trg) is phero[reg,trg] / sum(phero[:,trg])
+// and every edge is drawn independently. Instead of a trial per entry,
+// the regulators of each target are grouped in buckets of similar
+// probabilities -- bucket k holds the probabilities in (2^-(k+1), 2^-k].
+// Within a bucket, the candidates of probability q = 2^-k are found by
+// geometric skips and each one is accepted with probability p/q (>1/2),
+// so that the cost of a graph scales with its edges (and the buckets)
+// rather than with the entries of phero.
+
 Digraph *phero_model(GSLMatrix *phero) {
 
-  // calculate phero.sum(axis=0)
-  GSLVector *sumrows = [phero sumAcrossRows];
   // create graph
   Digraph *graph = [Digraph digraphWithNodes:settings.nodes];
-  int reg, trg;
-  double prob;
-  // calculate probabilities for each 
-  // pheromone matrix entry
-  // and decide whether to add the edge to the graph
-  for (trg=0; trg<[phero columns]; trg++)
-    for (reg=0; reg<[phero rows]; reg++) {
-      prob = [phero valueAtRow:reg andColumn:trg] / [sumrows valueAtIndex:trg];
-      if ([settings.rng getUniform] < prob)
-	[graph addEdgeFrom:[NSNumber numberWithInt:reg]
-			To:[NSNumber numberWithInt:trg]];
+  gsl_rng *rng = [current_rng() rng];
+  int n, trg, k, i, end, *start;
+  double q, lq, skip;
+  const int *regs;
+  const double *probs;
+
+  if (prepared.n == 0)
+    prepare_graphs(phero);
+  n = prepared.n;
+
+  for (trg=0; trg<n; trg++) {
+    start = prepared.start + trg * (PHERO_BUCKETS + 1);
+    regs = prepared.regs + trg * n;
+    probs = prepared.probs + trg * n;
+    for (k=0; k<PHERO_BUCKETS; k++) {
+      i = start[k];
+      end = start[k+1];
+      if (i == end)
+	continue;
+      q = ldexp(1, -k);
+      lq = log1p(-q);
+      while (1) {
+	// skip to the next candidate (every entry is one if q == 1)
+	if (k > 0) {
+	  skip = floor(log(1 - gsl_rng_uniform(rng)) / lq);
+	  if (skip >= end - i)
+	    break;
+	  i += (int)skip;
+	} else if (i >= end)
+	  break;
+	// and accept it with probability p/q
+	if (gsl_rng_uniform(rng) * q < probs[i])
+	  [graph addEdgeFrom:[prepared.nodes objectAtIndex:regs[i]]
+			  To:[prepared.nodes objectAtIndex:trg]];
+	i += 1;
+      }
     }
+  }
 
   return graph;
 }
@@ -240,32 +464,291 @@ Digraph *generate_graph(GSLMatrix *phero) {
   return g;
 }
 
+//=================================================================
+//          UPDATES OF THE SHARED STATE
+//=================================================================
+
+// the updates of each thread (see set_thread_updates())
+static pthread_key_t updates_key;
+static pthread_once_t updates_once = PTHREAD_ONCE_INIT;
+
+// guards settings.prior, which the asynchronous ACO updates while
+// other graphs are being evaluated (see aco.m)
+static pthread_mutex_t prior_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void make_updates_key(void) {
+
+  pthread_key_create(&updates_key, NULL);
+
+}
+
+
+static EvalUpdates *thread_updates(void) {
+
+  pthread_once(&updates_once, make_updates_key);
+  return pthread_getspecific(updates_key);
+
+}
+
+
+void set_thread_updates(EvalUpdates *updates) {
+
+  pthread_once(&updates_once, make_updates_key);
+  pthread_setspecific(updates_key, updates);
+
+}
+
+
+void update_prior(RNN *rnn, GSLVector *errors);
+
+
+// store a training in the cache (or record it, see EvalUpdates)
+void cache_params(GSLVector *params, double err, NSString *key) {
+
+  if (thread_updates())
+    [thread_updates() cacheParams:params
+			    error:err
+			   forKey:key];
+  else
+    [settings.cache setParams:params
+			error:err
+		       forKey:key];
+
+}
+
+
+
+@implementation EvalUpdates
+
+
+- (id) init {
+
+  self = [super init];
+  if (!self)
+    return nil;
+
+  keys = [[NSMutableArray alloc] init];
+  params = [[NSMutableArray alloc] init];
+  errors = [[NSMutableArray alloc] init];
+  rnns = [[NSMutableArray alloc] init];
+  rnnErrors = [[NSMutableArray alloc] init];
+
+  return self;
+
+}
+
+
+- (void) dealloc {
+
+  [keys release];
+  [params release];
+  [errors release];
+  [rnns release];
+  [rnnErrors release];
+  [super dealloc];
+
+}
+
+
+- (void) cacheParams:(GSLVector *)p
+	       error:(double)err
+	      forKey:(NSString *)key
+{
+
+  [keys addObject:key];
+  [params addObject:p];
+  [errors addObject:[NSNumber numberWithDouble:err]];
+
+}
+
+
+- (void) priorFrom:(RNN *)rnn
+	withErrors:(GSLVector *)v
+{
+
+  [rnns addObject:rnn];
+  [rnnErrors addObject:v];
+
+}
+
+
+- (void) apply {
+
+  int i;
+
+  for (i=0; i<[keys count]; i++)
+    [settings.cache setParams:[params objectAtIndex:i]
+			error:[[errors objectAtIndex:i] doubleValue]
+		       forKey:[keys objectAtIndex:i]];
+
+  for (i=0; i<[rnns count]; i++)
+    update_prior([rnns objectAtIndex:i], [rnnErrors objectAtIndex:i]);
+
+}
+
+@end
+
+
+
+//=================================================================
+// per-target training of the RNN that corresponds to graph g,
+// using the cache of trainings (settings.cache) 
+// returns the mean across the per-target optimization errors
+
+double train_nodes_with_cache(RNN *rnn, Digraph *g, 
+			      pso_settings_t *pso_settings) {
+
+  const cgraph_t *c = [g compact];
+  int trg, k;
+  double err, sum_err = 0;
+  NSMutableArray *sorted;
+  NSString *key;
+  GSLVector *params;
+
+  for (trg=0; trg<settings.nodes; trg++) {
+    // the regulators of trg (sorted, as in the cache key)
+    sorted = [NSMutableArray arrayWithCapacity:CGRAPH_IN_DEGREE(c, trg)];
+    for (k=c->in_ptr[trg]; k<c->in_ptr[trg+1]; k++)
+      [sorted addObject:[NSNumber numberWithInt:c->in[k]]];
+    key = [TrainCache keyForTarget:trg
+		    withRegulators:sorted
+			modelClass:settings.rnn_class
+		       psoSettings:pso_settings
+			 trainMode:settings.train_mode
+			 gradSteps:settings.grad_steps
+			  evalMode:settings.eval_mode];
+
+    params = [settings.cache paramsForKey:key
+				    error:&err];
+    if (params) {
+      // HIT :: the weights are in the order of the regulators
+      [rnn setFromVector:params
+	       withGraph:g
+		 forNode:trg];
+    } else {
+      // MISS :: train the target and store the result
+      err = [rnn trainNode:trg
+	     usingDynamics:settings.tdata
+		 withGraph:g
+	   withPSOSettings:pso_settings];
+      cache_params([rnn vectorForNode:trg
+		       withRegulators:sorted], err, key);
+    }
+
+    sum_err += err;
+  }
+
+  return sum_err / settings.nodes;
+
+}
+
+
+
+//=================================================================
+// keep the parameters of the targets of rnn that improve on the
+// best known parameters (settings.prior) -- errors are per target
+
+// all the nodes (the regulators of a dense row)
+static NSArray *all_nodes(void) {
+
+  int i;
+  NSMutableArray *all = [NSMutableArray arrayWithCapacity:settings.nodes];
+
+  for (i=0; i<settings.nodes; i++)
+    [all addObject:[NSNumber numberWithInt:i]];
+
+  return all;
+
+}
+
+
+void update_prior(RNN *rnn, GSLVector *errors) {
+
+  int trg;
+  NSArray *all = all_nodes();
+
+  pthread_mutex_lock(&prior_mutex);
+  for (trg=0; trg<settings.nodes; trg++)
+    if ([errors valueAtIndex:trg] < [settings.prior_errors valueAtIndex:trg]) {
+      // the weights of the non-regulators of trg are zero
+      [settings.prior setFromVector:[rnn vectorForNode:trg
+					withRegulators:all]
+			    forNode:trg];
+      [settings.prior_errors setValue:[errors valueAtIndex:trg]
+			      atIndex:trg];
+    }
+  pthread_mutex_unlock(&prior_mutex);
+
+}
+
+
+
+// a copy of the best known parameters (nil until every target
+// is known), which the training can read without locking
+static RNN *prior_snapshot(void) {
+
+  int trg;
+  NSArray *all;
+  RNN *copy = nil;
+
+  pthread_mutex_lock(&prior_mutex);
+  if (gsl_finite([settings.prior_errors max])) {
+    all = all_nodes();
+    copy = [settings.rnn_class rnnWithNodes:settings.nodes];
+    for (trg=0; trg<settings.nodes; trg++)
+      [copy setFromVector:[settings.prior vectorForNode:trg
+					 withRegulators:all]
+		  forNode:trg];
+  }
+  pthread_mutex_unlock(&prior_mutex);
+
+  return copy;
+
+}
+
+
+
 //=================================================================
 // graph evaluation function (using PSO)
 
-GSLVector *evaluate_graph(Digraph *g) {
+GSLVector *evaluate_graph(Digraph *g, long *evals) {
 
   // set up PSO parameters
   pso_settings_t pso_settings;
 
-  pso_set_default_settings(&pso_settings);
-  pso_settings.steps = settings.pso_steps;
-  if (settings.print_pso)
-    pso_settings.print_every = 100;
-  else
-    pso_settings.print_every = 0;
-  pso_settings.rng = [settings.rng rng];
-  // set obj_fun settings
-  pso_settings.x_lo = -20;
-  pso_settings.x_hi = 20;
-  pso_settings.goal = 1e-10;
+  set_pso_settings(&pso_settings);
+
+
+  // set up the gradient minimization
+  grad_settings_t grad_settings;
+
+  set_grad_settings(&grad_settings);
 
 
   // create RNN
   RNN *rnn = [settings.rnn_class rnnWithNodes:settings.nodes];
   double err;
-  // train it
-  if (settings.decomposition)
+  [rnn setTrainMode:settings.train_mode
+   withGradSettings:&grad_settings];
+  // seed the trainings from the best known parameters
+  // (as soon as every target is known)
+  if (settings.prior)
+    [rnn setWarmStart:prior_snapshot()];
+  // or from the least squares fit of the graph
+  if (settings.eval_mode == EVAL_LS_SEED) {
+    RNN *fit = [settings.rnn_class rnnWithNodes:settings.nodes];
+    [fit fitUsingDynamics:settings.tdata
+		withGraph:g];
+    [rnn setWarmStart:fit];
+  }
+  // train it (or just fit it)
+  if (settings.eval_mode == EVAL_LS)
+    err = [rnn fitUsingDynamics:settings.tdata
+		      withGraph:g];
+  else if (settings.decomposition && settings.cache)
+    err = train_nodes_with_cache(rnn, g, &pso_settings);
+  else if (settings.decomposition)
     err = [rnn dtrainUsingDynamics:settings.tdata
 			 withGraph:g
 		   withPSOSettings:&pso_settings];
@@ -291,5 +774,19 @@ GSLVector *evaluate_graph(Digraph *g) {
 
   // global error (err) is ignored; 
   // instead, return a vector of errors
-  return [settings.tdata calcMSEVector:[rnn predict:settings.tdata]];
+  GSLVector *errors = [settings.tdata calcMSEVector:[rnn predict:settings.tdata]];
+
+  // remember the improved targets
+  if (settings.prior) {
+    if (thread_updates())
+      [thread_updates() priorFrom:rnn
+		       withErrors:errors];
+    else
+      update_prior(rnn, errors);
+  }
+
+  if (evals)
+    *evals = [rnn evaluations];
+
+  return errors;
 }
@@ -1,12 +1,15 @@
 #import <Foundation/Foundation.h>
 #import <unistd.h>
+#import <sys/wait.h>
 
 #import "params.h"
 #import "aco.h"
 #import "pso.h"
+#import "grad.h"
 #import "RNN.h"
 #import "common.h"
 #import "Dynamics.h"
+#import "workers.h"
 
 
 void train() {
@@ -25,21 +28,18 @@ void train() {
   // set up PSO parameters
   pso_settings_t pso_settings;
 
-  pso_set_default_settings(&pso_settings);
-  pso_settings.steps = settings.pso_steps;
-  if (settings.print_pso)
-    pso_settings.print_every = 100;
-  else
-    pso_settings.print_every = 0;
-  pso_settings.rng = [settings.rng rng];
-  // set obj_fun settings
-  pso_settings.x_lo = -20;
-  pso_settings.x_hi = 20;
-  pso_settings.goal = 1e-10;
+  set_pso_settings(&pso_settings);
+  
+  // set up the gradient minimization
+  grad_settings_t grad_settings;
+
+  set_grad_settings(&grad_settings);
   
   // create RNN
   RNN *rnn = [settings.rnn_class rnnWithNodes:[graph countNodes]];
   double err;
+  [rnn setTrainMode:settings.train_mode
+   withGradSettings:&grad_settings];
 
   printf("Training RNN...\n");
 
@@ -69,6 +69,208 @@ void train() {
 }
 
 
+// initialize the caches and the warm start parameters
+void init_state() {
+
+  // initialize the training cache (problem decomposition only)
+  if (settings.decomposition && settings.cache_mb > 0)
+    settings.cache = [[TrainCache alloc] initWithCapacity:(size_t)settings.cache_mb << 20];
+  // initialize the cache of graph evaluations
+  if (settings.graph_cache > 0)
+    settings.gcache = [[GraphCache alloc] initWithCapacity:settings.graph_cache];
+
+  // initialize the warm start parameters (no target is known yet)
+  if (settings.warm_start) {
+    settings.prior = [[settings.rnn_class alloc] initWithNodes:settings.nodes];
+    settings.prior_errors = [[GSLVector alloc] initWithSize:settings.nodes];
+    [settings.prior_errors fillWithValue:GSL_POSINF];
+  }
+
+}
+
+
+
+// save the solution, the lamda factors of the steps that ran and the
+// stop reason of the ACO in log_path
+void save_results(Solution *solution, Dynamics *lamda) {
+
+  static const char *reasons[] = {"none", "lamda_stable", "gbest_stall", "low_entropy"};
+  NSString *fname;
+  Dynamics *ran = lamda;
+  FILE *stream;
+  int t, trg;
+
+  [solution save];
+
+  // an early stop leaves the rows of the later steps empty
+  if (settings.stop_reason != STOP_NONE) {
+    ran = [Dynamics dynamicsWithVars:settings.nodes
+			  andTPoints:settings.stop_step + 1];
+    for (t=0; t<=settings.stop_step; t++)
+      for (trg=0; trg<settings.nodes; trg++)
+	[ran setValue:[lamda valueOfVar:trg atTPoint:t]
+		ofVar:trg
+	     atTPoint:t];
+  }
+  [ran saveToFile:[settings.log_path stringByAppendingPathComponent:@"lamda.mat"]];
+
+  fname = [settings.log_path stringByAppendingPathComponent:STOP_FILE];
+  stream = fopen([fname UTF8String], "w");
+  if (stream) {
+    fprintf(stream, "%s %d\n", reasons[settings.stop_reason], settings.stop_step);
+    fclose(stream);
+  }
+
+}
+
+
+
+// run a member of the ensemble (in its own process) in log_path/run.SEED
+void ensemble_run(unsigned long seed, NSString *root) {
+
+  // the member's RNG and log path
+  settings.seed = seed;
+  [settings.rng release];
+  settings.rng = [[RNG alloc] initWithSeed:seed];
+  settings.log_path = [[root stringByAppendingPathComponent:
+			       [NSString stringWithFormat:@"run.%lu", seed]] retain];
+  save_settings();
+  // the output of the run goes to its log path
+  freopen([[settings.log_path stringByAppendingPathComponent:@"output"] UTF8String],
+	  "w", stdout);
+
+  init_state();
+
+  // run algorithm
+  Dynamics *lamda = [[Dynamics alloc] initWithVars:settings.nodes
+					andTPoints:settings.aco_steps];
+  Solution *solution = netinf(lamda);
+
+  // save solution and lamda vector in log_path
+  save_results(solution, lamda);
+
+  fflush(stdout);
+
+}
+
+
+
+// run netinf once per seed (settings.ensemble_jobs runs at a time)
+// and save the frequency of each edge in the solutions
+// the runs are forked from this process, so they share the data
+// (and everything else that has been set up so far)
+int ensemble() {
+
+  NSMutableArray *seeds = [NSMutableArray array];
+  // the seeds of the running runs (by pid) and of the successful ones
+  NSMutableDictionary *runs = [NSMutableDictionary dictionary];
+  NSMutableArray *done = [NSMutableArray array];
+  NSNumber *seed;
+  NSArray *tokens;
+  NSString *root = settings.log_path, *fname;
+  GSLMatrix *freq;
+  Digraph *graph;
+  NSArray *edges;
+  Edge *e;
+  int i, j, n, jobs, running = 0, next = 0, failed = 0, status, count = 0;
+  pid_t pid;
+
+  // the seeds of the runs
+  if (settings.ensemble) {
+    tokens = [settings.ensemble componentsSeparatedByString:@","];
+    for (i=0; i<[tokens count]; i++)
+      [seeds addObject:[NSNumber numberWithUnsignedLong:
+				   strtoul([[tokens objectAtIndex:i] UTF8String], NULL, 0)]];
+  } else
+    for (i=0; i<settings.ensemble_runs; i++)
+      [seeds addObject:[NSNumber numberWithUnsignedLong:settings.seed + i]];
+  n = [seeds count];
+
+  jobs = settings.ensemble_jobs > 0 ? settings.ensemble_jobs : sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs < 1)
+    jobs = 1;
+
+  // the runs evaluate their own graphs and save their own results
+  settings.workers = 0;
+  [settings.remote release];
+  settings.remote = nil;
+  settings.resume = NO;
+
+  printf("Running an ensemble of %d runs (%d at a time)\n", n, jobs);
+
+  while (next < n || running > 0) {
+    // start the next run
+    if (next < n && running < jobs) {
+      fflush(stdout);
+      pid = fork();
+      if (pid < 0) {
+	perror("fork");
+	return -1;
+      }
+      if (pid == 0) {
+	ensemble_run([[seeds objectAtIndex:next] unsignedLongValue], root);
+	_exit(0);
+      }
+      printf("Started run %d (seed %lu)\n", next,
+	     [[seeds objectAtIndex:next] unsignedLongValue]);
+      [runs setObject:[seeds objectAtIndex:next]
+	       forKey:[NSNumber numberWithInt:pid]];
+      next += 1;
+      running += 1;
+      continue;
+    }
+    // or wait for one to finish
+    pid = wait(&status);
+    if (pid < 0) {
+      perror("wait");
+      return -1;
+    }
+    seed = [runs objectForKey:[NSNumber numberWithInt:pid]];
+    if (!seed)
+      continue;
+    running -= 1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+      printf("Run (seed %lu) failed\n", [seed unsignedLongValue]);
+      failed += 1;
+    } else
+      [done addObject:seed];
+    [runs removeObjectForKey:[NSNumber numberWithInt:pid]];
+  }
+
+  // count the edges of the solutions of the successful runs
+  freq = [GSLMatrix matrixWithRows:settings.nodes
+			andColumns:settings.nodes];
+  [freq fillWithValue:0];
+  for (i=0; i<[done count]; i++) {
+    fname = [[root stringByAppendingPathComponent:
+		     [NSString stringWithFormat:@"run.%lu",
+			       [[done objectAtIndex:i] unsignedLongValue]]]
+	      stringByAppendingPathComponent:GRAPH_FILE];
+    graph = [Digraph digraphFromFile:fname];
+    if (!graph)
+      continue;
+    edges = [graph edges];
+    for (j=0; j<[edges count]; j++) {
+      e = [edges objectAtIndex:j];
+      [freq addValue:1
+	       atRow:[[e from] intValue]
+	   andColumn:[[e to] intValue]];
+    }
+    count += 1;
+  }
+  if (count > 0)
+    [freq divideByValue:count];
+  [freq saveToFile:[root stringByAppendingPathComponent:EDGE_FREQ_FILE]];
+
+  printf("Finished %d runs (%d failed)\nEdge frequencies : %s\n", count, failed,
+	 [[root stringByAppendingPathComponent:EDGE_FREQ_FILE] UTF8String]);
+
+  return count > 0 ? 0 : -1;
+
+}
+
+
+
 int main(int argc, char **argv) {
 
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
@@ -104,18 +306,47 @@ int main(int argc, char **argv) {
     system([cmd UTF8String]);
   }
 
+  // should we run an ensemble of netinf runs and exit??
+  if (settings.ensemble || settings.ensemble_runs > 0) {
+    res = ensemble();
+    if (settings.compress)
+      compress_dir(settings.log_path);
+    [settings.rng release];
+    [settings.tdata release];
+    [pool release];
+    return res;
+  }
+
+  // initialize the shared state of the graph evaluations
+  init_state();
+
+  // should we just serve graph evaluations to a coordinator??
+  if (settings.serve)
+    return workers_serve(settings.serve_addr ? [settings.serve_addr UTF8String] : "127.0.0.1",
+			 settings.serve);
+
+  // start the worker processes (they inherit the state above)
+  if (settings.workers > 0 && workers_spawn(settings.workers)) {
+    printf("Error starting the worker processes\nAborting.\n");
+    return -1;
+  }
+  if (settings.remote && workers_connect([settings.remote UTF8String])) {
+    printf("Error connecting to the remote workers\nAborting.\n");
+    return -1;
+  }
+
   // initialize lamda factor vector
   Dynamics *lamda = [[Dynamics alloc] initWithVars:settings.nodes
 					andTPoints:settings.aco_steps];
   // run algorithm
   Solution *solution = netinf(lamda);
+  // stop the workers
+  workers_close();
 
   // What to do with solution??
   if (settings.log_path) {
-    // save solution in log_path
-    [solution save];
-    // save lamda vector in log_path
-    [lamda saveToFile:[settings.log_path stringByAppendingPathComponent:@"lamda.mat"]];
+    // save solution and lamda vector in log_path
+    save_results(solution, lamda);
     // compress log_path??
     if (settings.compress) 
       compress_dir(settings.log_path);
@@ -129,6 +360,14 @@ int main(int argc, char **argv) {
   [solution release];
   [settings.rng release];
   [settings.tdata release];
+  [settings.cache release];
+  [settings.gcache release];
+  [settings.prior release];
+  [settings.prior_errors release];
+  [settings.remote release];
+  [settings.serve_addr release];
+  // stop the PSO evaluation threads
+  pso_free_thread_state();
   [pool release];
   return 0;
 
@@ -4,11 +4,27 @@
 #import <Foundation/Foundation.h>
 #import "GSL.h"
 #import "Dynamics.h"
+#import "cache.h"
+#import "pso.h"
+#import "grad.h"
+
+@class RNN;
 
 
 // FILE NAMES
 #define GRAPH_FILE @"solution.graph"
 #define ERRORS_FILE @"solution.errors"
+#define CHECKPOINT_FILE @"checkpoint"
+#define TRACE_FILE @"trace.bin"
+#define EDGE_FREQ_FILE @"edge.freq"
+#define STOP_FILE @"solution.stop"
+
+
+// ACO stop reasons
+#define STOP_NONE 0 // all steps
+#define STOP_LAMDA_STABLE 1 // the lamda factors did not change
+#define STOP_GBEST_STALL 2 // gbest did not improve
+#define STOP_LOW_ENTROPY 3 // the pheromone matrix converged
 
 
 // Generative model types
@@ -19,6 +35,11 @@
 #define MODEL_RNN 0
 #define MODEL_DRNN 1
 
+// Graph evaluation modes
+#define EVAL_TRAIN 0 // train the RNN (PSO and/or gradient, see RNN.h)
+#define EVAL_LS 1 // fit the RNN by logit least squares (no training)
+#define EVAL_LS_SEED 2 // train the RNN seeded with the least squares fit
+
 
 // FILE NAMES
 #define SETTINGS_FNAME @"settings"
@@ -49,9 +70,41 @@
 #define ACO_PHERO_VAL "aco_phero_val"
 #define ACO_RHO "aco_rho"
 #define ACO_LAMDA "aco_lamda"
+#define ANT_THREADS "ant_threads"
+#define ACO_ASYNC "aco_async"
+#define CHECKPOINT "checkpoint"
+#define RESUME "resume"
+#define TRACE "trace"
+#define STOP_LAMDA "stop_lamda"
+#define STOP_STALL "stop_stall"
+#define STOP_ENTROPY "stop_entropy"
 
 #define PSO_STEPS "pso_steps"
 #define PRINT_PSO "print_pso"
+#define THREADS "threads"
+#define PSO_STALL "pso_stall"
+#define PSO_STALL_TOL "pso_stall_tol"
+#define PSO_DIAMETER "pso_diameter"
+#define PSO_RESTART "pso_restart"
+
+#define CACHE_MB "cache_mb"
+#define GRAPH_CACHE "graph_cache"
+
+#define WARM_START "warm_start"
+
+#define TRAIN_MODE "train_mode"
+#define GRAD_STEPS "grad_steps"
+
+#define EVAL_MODE "eval_mode"
+
+#define WORKERS "workers"
+#define SERVE "serve"
+#define SERVE_ADDR "serve_addr"
+#define REMOTE "remote"
+
+#define ENSEMBLE "ensemble"
+#define ENSEMBLE_RUNS "ensemble_runs"
+#define ENSEMBLE_JOBS "ensemble_jobs"
 
 
 
@@ -61,6 +114,19 @@ int parse_settings(int argc, char **argv);
 // save settings to log_path (saves the tasks (env) as well)
 void save_settings();
 
+// initialize the PSO settings of a training (using settings)
+void set_pso_settings(pso_settings_t *pso_settings);
+
+// return the RNG of the calling thread (settings.rng unless the
+// thread has its own RNG, see set_thread_rng())
+RNG *current_rng(void);
+
+// set the RNG of the calling thread (nil : settings.rng)
+void set_thread_rng(RNG *rng);
+
+// initialize the gradient minimization settings of a training (using settings)
+void set_grad_settings(grad_settings_t *grad_settings);
+
 
 // program settings
 typedef struct {
@@ -105,10 +171,55 @@ typedef struct {
   double aco_phero_val; // initial value for the pheromome matrix
   double aco_rho; // pheromone evaporation rate
   double aco_lamda; // the lamda factor
+  int ant_threads; // number of threads that evaluate the ants of a step
+  BOOL aco_async; // whether each ant updates the pheromones on completion
+  int checkpoint; // save a checkpoint every INT ACO steps (0 : off)
+  BOOL resume; // whether to continue from the checkpoint in log_path
+  BOOL trace; // whether to trace every ant and step (see trace.h)
+  int stop_lamda; // stop when lamda is unchanged for INT steps (0 : off)
+  int stop_stall; // stop when gbest does not improve for INT steps (0 : off)
+  double stop_entropy; // stop when the phero entropy drops below it (0 : off)
+  int stop_reason; // why the ACO stopped (see STOP_*)
+  int stop_step; // the last step of the ACO
 
   // PSO parameters
   int pso_steps; // the number of PSO steps
   BOOL print_pso; // whether to print output from PSO (every 100 steps)
+  int threads; // the number of threads that evaluate the PSO swarm
+  int pso_stall; // the PSO stagnation window (steps; 0 : off)
+  double pso_stall_tol; // the min relative improvement within the window
+  double pso_diameter; // the min (relative) diameter of the swarm
+  BOOL pso_restart; // whether to re-seed the swarm on stagnation (or stop)
+
+  // training cache (problem decomposition only)
+  int cache_mb; // memory cap of the cache in MB (0 : no cache)
+  TrainCache *cache; // the cache of per-target trainings (could be nil)
+  int graph_cache; // max number of cached graph evaluations (0 : no cache)
+  GraphCache *gcache; // the cache of graph evaluations (could be nil)
+
+  // warm starts (graph trainings are seeded from the best known
+  // parameters of each target)
+  BOOL warm_start; // whether to seed the PSO swarms
+  RNN *prior; // the best known parameters of each target (could be nil)
+  GSLVector *prior_errors; // the errors of the targets of prior
+
+  // training mode (see RNN.h)
+  int train_mode; // PSO, PSO + gradient refinement or gradient only
+  int grad_steps; // max number of gradient minimization iterations
+
+  // graph evaluation
+  int eval_mode; // train the RNN, fit it by least squares or both
+
+  // worker processes (see workers.h)
+  int workers; // number of local worker processes (0 : none)
+  int serve; // serve graph evaluations on this TCP port (0 : off)
+  NSString *serve_addr; // the local address to serve on (loopback by default)
+  NSString *remote; // the remote workers ("host:port,...", could be nil)
+
+  // ensemble (one run per seed, see main.m)
+  NSString *ensemble; // the seeds of the runs ("1,2,...", could be nil)
+  int ensemble_runs; // or the number of runs (seeds : seed, seed+1, ...)
+  int ensemble_jobs; // the number of concurrent runs (0 : one per CPU)
 
 
 } params_t;
@@ -2,10 +2,12 @@
 #import <getopt.h>
 #import <stdio.h>
 #import <sys/stat.h>
+#import <pthread.h>
 
 #import "Graph.h"
 
 #import "pso.h"
+#import "grad.h"
 
 #import "RNN.h"
 
@@ -47,9 +49,47 @@ params_t settings = {
     10., // aco_phero_val
     0.1, // aco_rho
     0.1, // aco_lamda
+    1, // ant_threads
+    NO, // aco_async
+    0, // checkpoint
+    NO, // resume
+    NO, // trace
+    0, // stop_lamda
+    0, // stop_stall
+    0, // stop_entropy
+    STOP_NONE, // stop_reason
+    0, // stop_step
 
     1000, // pso_steps
-    NO // print_pso
+    NO, // print_pso
+    1, // threads
+    0, // pso_stall
+    1e-6, // pso_stall_tol
+    0, // pso_diameter
+    NO, // pso_restart
+
+    64, // cache_mb
+    nil, // cache
+    1024, // graph_cache
+    nil, // gcache
+
+    NO, // warm_start
+    nil, // prior
+    nil, // prior_errors
+
+    0, // train_mode
+    100, // grad_steps
+
+    EVAL_TRAIN, // eval_mode
+
+    0, // workers
+    0, // serve
+    nil, // serve_addr
+    nil, // remote
+
+    nil, // ensemble
+    0, // ensemble_runs
+    0 // ensemble_jobs
 
 };
 
@@ -85,10 +125,119 @@ void print_help() {
     printf("  --aco_phero_val FLOAT : set the initial pheromone matrix value\n");
     printf("  --aco_rho FLOAT : set the pheromone evaporation rate\n");
     printf("  --aco_lamda FLOAT : set the lamda factor \n");
+    printf("  --ant_threads INT : set the number of threads that evaluate the ants of a step\n");
+    printf("  --aco_async : update the pheromone matrix as soon as each ant is evaluated\n");
+    printf("  --checkpoint INT : save a checkpoint in the log path every INT ACO steps (0:off)\n");
+    printf("  --resume : continue from the checkpoint in the log path\n");
+    printf("  --trace : write a binary trace of every ant and step in the log path (see netinf_trace)\n");
+    printf("  --stop_lamda INT : stop when the lamda factors do not change for INT steps (0:off)\n");
+    printf("  --stop_stall INT : stop when gbest does not improve for INT steps (0:off)\n");
+    printf("  --stop_entropy FLOAT : stop when the (normalized) pheromone entropy drops below FLOAT (0:off)\n");
 
     printf("PSO PARAMETERS\n");
     printf("  --pso_steps INT : set the number of steps for PSO\n");
     printf("  -p or --print_pso : print PSO output\n");
+    printf("  --threads INT : set the number of threads that evaluate the PSO swarm\n");
+    printf("  --pso_stall INT : stop PSO after INT steps without improvement (0:off)\n");
+    printf("  --pso_stall_tol FLOAT : the min relative improvement within pso_stall steps\n");
+    printf("  --pso_diameter FLOAT : stop PSO when the (relative) swarm diameter drops below FLOAT\n");
+    printf("  --pso_restart : re-seed half of the swarm on stagnation (instead of stopping)\n");
+
+    printf("CACHE PARAMETERS\n");
+    printf("  --cache_mb INT : memory cap (MB) of the per-target training cache (0:off)\n");
+    printf("  --graph_cache INT : max number of cached graph evaluations (duplicate ants; 0:off)\n");
+
+    printf("WARM START\n");
+    printf("  --warm_start : seed PSO from the best known parameters of each target\n");
+
+    printf("TRAINING MODE\n");
+    printf("  --train_mode INT : 0:PSO, 1:PSO + gradient refinement, 2:gradient only\n");
+    printf("  --grad_steps INT : max number of iterations of the gradient minimization\n");
+
+    printf("GRAPH EVALUATION\n");
+    printf("  --eval_mode INT : 0:train the RNN, 1:logit least squares fit, 2:train seeded with the fit\n");
+
+    printf("WORKER PROCESSES\n");
+    printf("  --workers INT : evaluate the graphs on INT local worker processes\n");
+    printf("  --serve INT : serve graph evaluations on TCP port INT (no log path needed)\n");
+    printf("  --serve_addr STRING : the local address to serve on (default: 127.0.0.1; 0.0.0.0 : all)\n");
+    printf("  --remote STRING : evaluate the graphs on the remote workers host:port,host:port,...\n");
+
+    printf("ENSEMBLE\n");
+    printf("  --ensemble STRING : run netinf once per seed in the list 1,2,... (in log_path/run.SEED)\n");
+    printf("  --ensemble_runs INT : run netinf INT times (seeds : seed, seed+1, ...)\n");
+    printf("  --ensemble_jobs INT : the number of concurrent runs (0:one per CPU)\n");
+
+}
+
+
+
+
+void set_pso_settings(pso_settings_t *pso_settings) {
+
+    pso_set_default_settings(pso_settings);
+    pso_settings->steps = settings.pso_steps;
+    if (settings.print_pso)
+	pso_settings->print_every = 100;
+    else
+	pso_settings->print_every = 0;
+    pso_settings->rng = [current_rng() rng];
+    pso_settings->threads = settings.threads;
+    // set obj_fun settings
+    pso_settings->x_lo = -20;
+    pso_settings->x_hi = 20;
+    pso_settings->goal = 1e-10;
+    // stagnation
+    pso_settings->stall_steps = settings.pso_stall;
+    pso_settings->stall_tol = settings.pso_stall_tol;
+    pso_settings->min_diameter = settings.pso_diameter;
+    pso_settings->stall_strategy = settings.pso_restart ? 
+	PSO_STALL_RESTART : PSO_STALL_STOP;
+
+}
+
+
+
+void set_grad_settings(grad_settings_t *grad_settings) {
+
+    grad_set_default_settings(grad_settings);
+    grad_settings->steps = settings.grad_steps;
+
+}
+
+
+
+
+// the RNG of each thread (see current_rng())
+static pthread_key_t rng_key;
+static pthread_once_t rng_once = PTHREAD_ONCE_INIT;
+
+
+static void make_rng_key(void) {
+
+    pthread_key_create(&rng_key, NULL);
+
+}
+
+
+
+RNG *current_rng(void) {
+
+    RNG *rng;
+
+    pthread_once(&rng_once, make_rng_key);
+    rng = pthread_getspecific(rng_key);
+
+    return rng ? rng : settings.rng;
+
+}
+
+
+
+void set_thread_rng(RNG *rng) {
+
+    pthread_once(&rng_once, make_rng_key);
+    pthread_setspecific(rng_key, rng);
 
 }
 
@@ -131,8 +280,43 @@ void save_settings() {
     fprintf(f, "--%s %.1f ", ACO_PHERO_VAL, settings.aco_phero_val);
     fprintf(f, "--%s %.1f ", ACO_RHO, settings.aco_rho);
     fprintf(f, "--%s %.1f ", ACO_LAMDA, settings.aco_lamda);
+    fprintf(f, "--%s %d ", ANT_THREADS, settings.ant_threads);
+    if (settings.aco_async)
+	fprintf(f, "--%s ", ACO_ASYNC);
+    fprintf(f, "--%s %d ", CHECKPOINT, settings.checkpoint);
+    if (settings.trace)
+	fprintf(f, "--%s ", TRACE);
+    fprintf(f, "--%s %d ", STOP_LAMDA, settings.stop_lamda);
+    fprintf(f, "--%s %d ", STOP_STALL, settings.stop_stall);
+    fprintf(f, "--%s %g ", STOP_ENTROPY, settings.stop_entropy);
 
     fprintf(f, "--%s %d ", PSO_STEPS, settings.pso_steps);
+    fprintf(f, "--%s %d ", THREADS, settings.threads);
+    fprintf(f, "--%s %d ", PSO_STALL, settings.pso_stall);
+    fprintf(f, "--%s %g ", PSO_STALL_TOL, settings.pso_stall_tol);
+    fprintf(f, "--%s %g ", PSO_DIAMETER, settings.pso_diameter);
+    if (settings.pso_restart)
+	fprintf(f, "--%s ", PSO_RESTART);
+
+    fprintf(f, "--%s %d ", CACHE_MB, settings.cache_mb);
+    fprintf(f, "--%s %d ", GRAPH_CACHE, settings.graph_cache);
+
+    if (settings.warm_start)
+	fprintf(f, "--%s ", WARM_START);
+
+    fprintf(f, "--%s %d ", TRAIN_MODE, settings.train_mode);
+    fprintf(f, "--%s %d ", GRAD_STEPS, settings.grad_steps);
+
+    fprintf(f, "--%s %d ", EVAL_MODE, settings.eval_mode);
+
+    fprintf(f, "--%s %d ", WORKERS, settings.workers);
+    if (settings.remote)
+	fprintf(f, "--%s %s ", REMOTE, [settings.remote UTF8String]);
+
+    if (settings.ensemble)
+	fprintf(f, "--%s %s ", ENSEMBLE, [settings.ensemble UTF8String]);
+    fprintf(f, "--%s %d ", ENSEMBLE_RUNS, settings.ensemble_runs);
+    fprintf(f, "--%s %d ", ENSEMBLE_JOBS, settings.ensemble_jobs);
 
     fclose(f);
 
@@ -179,9 +363,41 @@ int parse_settings(int argc, char **argv) {
 	    {ACO_PHERO_VAL, required_argument, 0, 0},
 	    {ACO_RHO, required_argument, 0, 0},
 	    {ACO_LAMDA, required_argument, 0, 0},
+	    {ANT_THREADS, required_argument, 0, 0},
+	    {ACO_ASYNC, no_argument, 0, 0},
+	    {CHECKPOINT, required_argument, 0, 0},
+	    {RESUME, no_argument, 0, 0},
+	    {TRACE, no_argument, 0, 0},
+	    {STOP_LAMDA, required_argument, 0, 0},
+	    {STOP_STALL, required_argument, 0, 0},
+	    {STOP_ENTROPY, required_argument, 0, 0},
 
 	    {PSO_STEPS, required_argument, 0, 0},
 	    {PRINT_PSO, no_argument, 0, 'p'},
+	    {THREADS, required_argument, 0, 0},
+	    {PSO_STALL, required_argument, 0, 0},
+	    {PSO_STALL_TOL, required_argument, 0, 0},
+	    {PSO_DIAMETER, required_argument, 0, 0},
+	    {PSO_RESTART, no_argument, 0, 0},
+
+	    {CACHE_MB, required_argument, 0, 0},
+	    {GRAPH_CACHE, required_argument, 0, 0},
+
+	    {WARM_START, no_argument, 0, 0},
+
+	    {TRAIN_MODE, required_argument, 0, 0},
+	    {GRAD_STEPS, required_argument, 0, 0},
+
+	    {EVAL_MODE, required_argument, 0, 0},
+
+	    {WORKERS, required_argument, 0, 0},
+	    {SERVE, required_argument, 0, 0},
+	    {SERVE_ADDR, required_argument, 0, 0},
+	    {REMOTE, required_argument, 0, 0},
+
+	    {ENSEMBLE, required_argument, 0, 0},
+	    {ENSEMBLE_RUNS, required_argument, 0, 0},
+	    {ENSEMBLE_JOBS, required_argument, 0, 0},
 
 	    {"help", no_argument, 0, 'h'},
 	    // {"file", 1, 0, 0},
@@ -234,11 +450,76 @@ int parse_settings(int argc, char **argv) {
 		    settings.aco_rho = atof(optarg);
 		else if (strcmp(optname, ACO_LAMDA) == 0)
 		    settings.aco_lamda = atof(optarg);
+		else if (strcmp(optname, ANT_THREADS) == 0)
+		    settings.ant_threads = atoi(optarg);
+		else if (strcmp(optname, CHECKPOINT) == 0)
+		    settings.checkpoint = atoi(optarg);
+		else if (strcmp(optname, STOP_LAMDA) == 0)
+		    settings.stop_lamda = atoi(optarg);
+		else if (strcmp(optname, STOP_STALL) == 0)
+		    settings.stop_stall = atoi(optarg);
+		else if (strcmp(optname, STOP_ENTROPY) == 0)
+		    settings.stop_entropy = atof(optarg);
 
 		else if (strcmp(optname, PSO_STEPS) == 0)
 		    settings.pso_steps = atoi(optarg);
+		else if (strcmp(optname, THREADS) == 0)
+		    settings.threads = atoi(optarg);
+		else if (strcmp(optname, PSO_STALL) == 0)
+		    settings.pso_stall = atoi(optarg);
+		else if (strcmp(optname, PSO_STALL_TOL) == 0)
+		    settings.pso_stall_tol = atof(optarg);
+		else if (strcmp(optname, PSO_DIAMETER) == 0)
+		    settings.pso_diameter = atof(optarg);
+
+		else if (strcmp(optname, CACHE_MB) == 0)
+		    settings.cache_mb = atoi(optarg);
+		else if (strcmp(optname, GRAPH_CACHE) == 0)
+		    settings.graph_cache = atoi(optarg);
+
+		else if (strcmp(optname, TRAIN_MODE) == 0)
+		    settings.train_mode = atoi(optarg);
+		else if (strcmp(optname, GRAD_STEPS) == 0)
+		    settings.grad_steps = atoi(optarg);
+
+		else if (strcmp(optname, EVAL_MODE) == 0)
+		    settings.eval_mode = atoi(optarg);
+
+		else if (strcmp(optname, WORKERS) == 0)
+		    settings.workers = atoi(optarg);
+		else if (strcmp(optname, SERVE) == 0)
+		    settings.serve = atoi(optarg);
+		else if (strcmp(optname, SERVE_ADDR) == 0)
+		    settings.serve_addr = [[NSString alloc] initWithCString:optarg
+								  encoding:NSASCIIStringEncoding];
+		else if (strcmp(optname, REMOTE) == 0)
+		    settings.remote = [[NSString alloc] initWithCString:optarg
+							       encoding:NSUTF8StringEncoding];
+
+		else if (strcmp(optname, ENSEMBLE) == 0)
+		    settings.ensemble = [[NSString alloc] initWithCString:optarg
+								 encoding:NSUTF8StringEncoding];
+		else if (strcmp(optname, ENSEMBLE_RUNS) == 0)
+		    settings.ensemble_runs = atoi(optarg);
+		else if (strcmp(optname, ENSEMBLE_JOBS) == 0)
+		    settings.ensemble_jobs = atoi(optarg);
 
 		printf("Setting %s=%s\n", optname, optarg);
+	    } else if (strcmp(long_options[option_index].name, PSO_RESTART) == 0) {
+		printf("Re-seeding PSO swarm on stagnation\n");
+		settings.pso_restart = YES;
+	    } else if (strcmp(long_options[option_index].name, WARM_START) == 0) {
+		printf("Warm-starting PSO from the best known parameters\n");
+		settings.warm_start = YES;
+	    } else if (strcmp(long_options[option_index].name, ACO_ASYNC) == 0) {
+		printf("Running the asynchronous (steady-state) ACO\n");
+		settings.aco_async = YES;
+	    } else if (strcmp(long_options[option_index].name, RESUME) == 0) {
+		printf("Resuming from the last checkpoint\n");
+		settings.resume = YES;
+	    } else if (strcmp(long_options[option_index].name, TRACE) == 0) {
+		printf("Tracing the ants\n");
+		settings.trace = YES;
 	    }
 	    break;
 
@@ -274,8 +555,8 @@ int parse_settings(int argc, char **argv) {
 	}
     }
 
-    // is a log_path defined??
-    if (! settings.log_path) {
+    // is a log_path defined?? (a worker does not log anything)
+    if (! settings.log_path && ! settings.serve) {
       printf("netinf: please specify a log path using the --log_path switch\n");
       return -1;
     }
@@ -0,0 +1,111 @@
+/* Prediction kernels for RNN/DRNN models
+
+   The kernels operate directly on the raw gsl data of the training
+   dynamics and of the model parameters, so that they can be called
+   from the PSO objective functions without creating any objects.
+
+   Conventions (same as in RNN.h) :
+
+   ** X, P : (tpoints x nodes) matrices -- rows are time points
+   ** W : (nodes x nodes) weight matrix -- W[i,j] indicates how
+          target node i is regulated by regulator node j
+   ** B : bias terms (one per node)
+   ** T : time constants (one per node) -- NULL for a plain RNN
+   ** csr : compressed sparse-row view of W, holding only the active
+            regulators of each target (see predict_csr_t below)
+ */
+
+#ifndef PREDICT_H_
+#define PREDICT_H_
+
+#include <gsl/gsl_matrix.h>
+
+
+// COMPRESSED SPARSE-ROW VIEW OF THE WEIGHT MATRIX
+typedef struct predict_csr {
+
+    int nodes; // number of targets (rows)
+    int nnz; // number of active regulators (i.e. graph edges)
+    int *rowptr; // the entries of target i are in [rowptr[i], rowptr[i+1])
+    int *reg; // the regulator (column) of each entry
+    double *w; // the weight of each entry
+    int *edge; // the entry of each edge (in the graph's edge order)
+
+} predict_csr_t;
+
+
+// allocate/free a CSR view (the entries are not initialized)
+predict_csr_t *predict_csr_alloc(int nodes, int nnz);
+void predict_csr_free(predict_csr_t *csr);
+
+
+// one-step-ahead prediction of the whole trajectory X into P
+// the first time point of P is copied from X; the pre-activations of
+// all the remaining time points are calculated as a single matrix
+// product (X[0..T-2] * W^T) followed by an activation pass
+void predict_trajectory(const gsl_matrix *X, const gsl_matrix *W,
+			const double *B, const double *T, double delta_t,
+			gsl_matrix *P);
+
+// same as predict_trajectory, using the sparse view of W
+// (costs O(tpoints * nnz) instead of O(tpoints * nodes^2))
+void predict_trajectory_csr(const gsl_matrix *X, const predict_csr_t *csr,
+			    const double *B, const double *T, double delta_t,
+			    gsl_matrix *P);
+
+// one-step-ahead prediction of the trajectory X by a batch of count
+// models and their MSEs (the training data are shared by all models)
+// ** Ws stacks the weight matrices of the models, i.e. rows
+//    m*nodes..(m+1)*nodes-1 hold W of the m^th model
+// ** B[m], T[m] are the bias terms/time constants of the m^th model
+//    (T is NULL for plain RNNs)
+// ** P (tpoints x count*nodes) receives the predictions; columns
+//    m*nodes..(m+1)*nodes-1 hold the prediction of the m^th model
+// ** mse[m] receives the MSE of the m^th model
+// the pre-activations of all models are calculated as a single matrix
+// product (X[0..T-2] * Ws^T)
+void predict_batch_mse(const gsl_matrix *X, const gsl_matrix *Ws,
+		       const double **B, const double **T, double delta_t,
+		       int count, gsl_matrix *P, double *mse);
+
+// same as predict_batch_mse, for a batch of sparse models that share
+// the structure of csr (the weights of csr are ignored)
+// Wk (count x nnz) holds the weights of each model (in csr order)
+void predict_batch_csr_mse(const gsl_matrix *X, const predict_csr_t *csr,
+			   const double *Wk, const double **B,
+			   const double **T, double delta_t,
+			   int count, gsl_matrix *P, double *mse);
+
+// calculate the pre-activations of a single target (with bias b
+// and regulators reg) for time points 1..T-1
+// i.e. u[t-1] = b + sum_k w[k] * X[t-1, reg[k]]
+// reg may be NULL, in which case the regulators are 0..nregs-1
+void predict_column(const gsl_matrix *X, const int *reg, const double *w,
+		    int nregs, double b, double *u);
+
+// fused one-step-ahead prediction and MSE of target trg (with bias b,
+// regulators reg and integration factor *alpha, see predict_column())
+// the prediction is never stored; the squared errors are accumulated
+// in blocks of time points and the calculation is abandoned as soon as
+// the partial MSE exceeds cutoff (the returned value is then a lower
+// bound of the MSE, which is still greater than cutoff)
+// alpha is NULL for a plain RNN (i.e. no leaky integration)
+double predict_target_mse(const gsl_matrix *X, int trg, const int *reg,
+			  const double *w, int nregs, double b,
+			  const double *alpha, double cutoff);
+
+// one-step-ahead MSE of target trg (with bias b and regulators reg,
+// see predict_column()) and its gradient, with respect to the weights
+// w, the bias term b and the time constant *T (DRNN only)
+// ** T is NULL for a plain RNN
+// ** grad (if not NULL) receives the gradient in the order of the
+//    parameters of a node, i.e. nregs weights, b and *T
+double predict_target_grad(const gsl_matrix *X, int trg, const int *reg,
+			   const double *w, int nregs, double b,
+			   const double *T, double delta_t, double *grad);
+
+// return the mean squared error between X and P (across all entries)
+double predict_mse(const gsl_matrix *X, const gsl_matrix *P);
+
+
+#endif // PREDICT_H_
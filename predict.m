@@ -0,0 +1,407 @@
+/* Prediction kernels for RNN/DRNN models -- see predict.h */
+
+#include "predict.h"
+#include "activation.h"
+
+#include <gsl/gsl_blas.h>
+#include <stdlib.h> // for malloc()
+#include <string.h> // for memcpy()
+
+
+// number of time points per block (see predict_target_mse())
+#define PREDICT_BLOCK 32
+
+
+
+//==============================================================
+//                   SPARSE WEIGHT MATRIX
+//==============================================================
+
+predict_csr_t *predict_csr_alloc(int nodes, int nnz) {
+
+    predict_csr_t *csr = malloc(sizeof(predict_csr_t));
+
+    csr->nodes = nodes;
+    csr->nnz = nnz;
+    csr->rowptr = malloc(sizeof(int) * (nodes + 1));
+    // allocate at least one element (nnz could be zero)
+    csr->reg = malloc(sizeof(int) * (nnz + 1));
+    csr->w = malloc(sizeof(double) * (nnz + 1));
+    csr->edge = malloc(sizeof(int) * (nnz + 1));
+
+    return csr;
+
+}
+
+
+
+void predict_csr_free(predict_csr_t *csr) {
+
+    if (!csr)
+	return;
+
+    free(csr->rowptr);
+    free(csr->reg);
+    free(csr->w);
+    free(csr->edge);
+    free(csr);
+
+}
+
+
+
+//==============================================================
+//                 TRAJECTORY PREDICTION
+//==============================================================
+
+// activation pass over rows 1..T-1 of P
+static void activate_trajectory(const gsl_matrix *X, const double *B,
+				const double *T, double delta_t,
+				gsl_matrix *P)
+{
+
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    size_t t, i;
+    double alpha[nodes]; // delta_t / T (DRNN only)
+
+    if (T) {
+	// DRNN :: leaky integration of the sigmoid output
+	// (the integration factors are the same for all time points)
+	for (i=0; i<nodes; i++)
+	    alpha[i] = delta_t / T[i];
+	for (t=1; t<tpoints; t++)
+	    act_decay(gsl_matrix_ptr(P, t, 0), B, alpha,
+		      gsl_matrix_const_ptr(X, t-1, 0), nodes);
+    } else
+	// RNN :: plain sigmoid
+	for (t=1; t<tpoints; t++)
+	    act_sigmoid(gsl_matrix_ptr(P, t, 0), B, nodes);
+
+}
+
+
+
+void predict_trajectory(const gsl_matrix *X, const gsl_matrix *W,
+			const double *B, const double *T, double delta_t,
+			gsl_matrix *P)
+{
+
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    gsl_matrix_const_view xprev; // time points 0..T-2 of X
+    gsl_matrix_view pnext; // time points 1..T-1 of P
+
+    // copy first time point from X
+    memcpy(gsl_matrix_ptr(P, 0, 0), gsl_matrix_const_ptr(X, 0, 0),
+	   sizeof(double) * nodes);
+    if (tpoints < 2)
+	return;
+
+    // calculate the pre-activations of all targets at all time points
+    // i.e. P[1..T-1] = X[0..T-2] * W^T
+    xprev = gsl_matrix_const_submatrix(X, 0, 0, tpoints-1, nodes);
+    pnext = gsl_matrix_submatrix(P, 1, 0, tpoints-1, nodes);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1., &xprev.matrix, W,
+		   0., &pnext.matrix);
+
+    // activation pass
+    activate_trajectory(X, B, T, delta_t, P);
+
+}
+
+
+
+void predict_trajectory_csr(const gsl_matrix *X, const predict_csr_t *csr,
+			    const double *B, const double *T, double delta_t,
+			    gsl_matrix *P)
+{
+
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    size_t t;
+    int trg, k;
+    const double *x;
+    double *p, wsum;
+
+    // copy first time point from X
+    memcpy(gsl_matrix_ptr(P, 0, 0), gsl_matrix_const_ptr(X, 0, 0),
+	   sizeof(double) * nodes);
+
+    // calculate the pre-activations using the active regulators only
+    for (t=1; t<tpoints; t++) {
+	x = gsl_matrix_const_ptr(X, t-1, 0);
+	p = gsl_matrix_ptr(P, t, 0);
+	for (trg=0; trg<csr->nodes; trg++) {
+	    wsum = 0;
+	    for (k=csr->rowptr[trg]; k<csr->rowptr[trg+1]; k++)
+		wsum += csr->w[k] * x[csr->reg[k]];
+	    p[trg] = wsum;
+	}
+    }
+
+    // activation pass
+    activate_trajectory(X, B, T, delta_t, P);
+
+}
+
+
+
+//==============================================================
+//                   BATCH PREDICTION
+//==============================================================
+
+// activation pass and MSE of each model of the batch
+// (the pre-activations are already in rows 1..T-1 of P)
+static void activate_batch(const gsl_matrix *X,
+			   const double **B, const double **T, double delta_t,
+			   int count, gsl_matrix *P, double *mse)
+{
+
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    int m;
+    gsl_matrix_view pm; // the prediction of the m^th model
+
+    for (m=0; m<count; m++) {
+	pm = gsl_matrix_submatrix(P, 0, m * nodes, tpoints, nodes);
+	// copy first time point from X
+	memcpy(gsl_matrix_ptr(&pm.matrix, 0, 0), gsl_matrix_const_ptr(X, 0, 0),
+	       sizeof(double) * nodes);
+	activate_trajectory(X, B[m], T ? T[m] : NULL, delta_t, &pm.matrix);
+	mse[m] = predict_mse(X, &pm.matrix);
+    }
+
+}
+
+
+
+void predict_batch_mse(const gsl_matrix *X, const gsl_matrix *Ws,
+		       const double **B, const double **T, double delta_t,
+		       int count, gsl_matrix *P, double *mse)
+{
+
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    gsl_matrix_const_view xprev; // time points 0..T-2 of X
+    gsl_matrix_const_view ws; // the weights of the batch
+    gsl_matrix_view pnext; // time points 1..T-1 of P (batch columns)
+
+    // calculate the pre-activations of all models at all time points
+    // i.e. P[1..T-1] = X[0..T-2] * Ws^T
+    if (tpoints > 1) {
+	xprev = gsl_matrix_const_submatrix(X, 0, 0, tpoints-1, nodes);
+	ws = gsl_matrix_const_submatrix(Ws, 0, 0, count * nodes, nodes);
+	pnext = gsl_matrix_submatrix(P, 1, 0, tpoints-1, count * nodes);
+	gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1., &xprev.matrix, 
+		       &ws.matrix, 0., &pnext.matrix);
+    }
+
+    // activation pass
+    activate_batch(X, B, T, delta_t, count, P, mse);
+
+}
+
+
+
+void predict_batch_csr_mse(const gsl_matrix *X, const predict_csr_t *csr,
+			   const double *Wk, const double **B,
+			   const double **T, double delta_t,
+			   int count, gsl_matrix *P, double *mse)
+{
+
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    size_t t;
+    int m, trg, k;
+    const double *x, *w;
+    double *p, wsum;
+
+    // calculate the pre-activations of all models using the active
+    // regulators only -- each time point of X is visited once
+    // for the whole batch
+    for (t=1; t<tpoints; t++) {
+	x = gsl_matrix_const_ptr(X, t-1, 0);
+	for (m=0; m<count; m++) {
+	    p = gsl_matrix_ptr(P, t, m * nodes);
+	    w = Wk + m * csr->nnz;
+	    for (trg=0; trg<csr->nodes; trg++) {
+		wsum = 0;
+		for (k=csr->rowptr[trg]; k<csr->rowptr[trg+1]; k++)
+		    wsum += w[k] * x[csr->reg[k]];
+		p[trg] = wsum;
+	    }
+	}
+    }
+
+    // activation pass
+    activate_batch(X, B, T, delta_t, count, P, mse);
+
+}
+
+
+
+//==============================================================
+//                   SINGLE TARGET PREDICTION
+//==============================================================
+
+// pre-activations of a single target for time points t0..t0+n-1
+static inline void column_preact(const gsl_matrix *X, const int *reg,
+				 const double *w, int nregs, double b,
+				 size_t t0, size_t n, double *u)
+{
+
+    size_t t;
+    int k;
+    const double *x;
+    double wsum;
+
+    for (t=t0; t<t0+n; t++) {
+	x = gsl_matrix_const_ptr(X, t-1, 0);
+	wsum = b;
+	if (reg)
+	    for (k=0; k<nregs; k++)
+		wsum += w[k] * x[reg[k]];
+	else
+	    for (k=0; k<nregs; k++)
+		wsum += w[k] * x[k];
+	u[t-t0] = wsum;
+    }
+
+}
+
+
+
+void predict_column(const gsl_matrix *X, const int *reg, const double *w,
+		    int nregs, double b, double *u)
+{
+
+    if (X->size1 > 1)
+	column_preact(X, reg, w, nregs, b, 1, X->size1 - 1, u);
+
+}
+
+
+
+double predict_target_mse(const gsl_matrix *X, int trg, const int *reg,
+			  const double *w, int nregs, double b,
+			  const double *alpha, double cutoff)
+{
+
+    size_t tpoints = X->size1;
+    size_t t0, n, i;
+    double u[PREDICT_BLOCK]; // predictions of the current block
+    double a[PREDICT_BLOCK]; // integration factors (DRNN only)
+    double xprev[PREDICT_BLOCK]; // previous values of the target
+    double diff, sdiff = 0;
+    // the partial sum of squared errors that abandons the calculation
+    double limit = cutoff * tpoints;
+
+    if (alpha)
+	for (i=0; i<PREDICT_BLOCK; i++)
+	    a[i] = *alpha;
+
+    // the first time point is copied from X (i.e. zero error)
+    for (t0=1; t0<tpoints; t0+=n) {
+	n = (tpoints - t0 < PREDICT_BLOCK) ? tpoints - t0 : PREDICT_BLOCK;
+	// predict the block
+	column_preact(X, reg, w, nregs, b, t0, n, u);
+	if (alpha) {
+	    for (i=0; i<n; i++)
+		xprev[i] = gsl_matrix_get(X, t0+i-1, trg);
+	    act_decay(u, NULL, a, xprev, n);
+	} else
+	    act_sigmoid(u, NULL, n);
+	// accumulate the squared errors
+	for (i=0; i<n; i++) {
+	    diff = gsl_matrix_get(X, t0+i, trg) - u[i];
+	    sdiff += diff * diff;
+	}
+	// abandon??
+	if (sdiff > limit)
+	    break;
+    }
+
+    return sdiff / tpoints;
+
+}
+
+
+
+double predict_target_grad(const gsl_matrix *X, int trg, const int *reg,
+			   const double *w, int nregs, double b,
+			   const double *T, double delta_t, double *grad)
+{
+
+    size_t tpoints = X->size1;
+    size_t t0, n, i;
+    int k;
+    double s[PREDICT_BLOCK]; // sigmoid outputs of the current block
+    double a = T ? delta_t / *T : 1; // integration factor
+    double xprev, p, e, g, du, sdiff = 0;
+    const double *x;
+
+    if (grad)
+	memset(grad, 0, sizeof(double) * (nregs + (T ? 2 : 1)));
+
+    // the first time point is copied from X (i.e. zero error)
+    for (t0=1; t0<tpoints; t0+=n) {
+	n = (tpoints - t0 < PREDICT_BLOCK) ? tpoints - t0 : PREDICT_BLOCK;
+	// the sigmoid outputs of the block
+	column_preact(X, reg, w, nregs, b, t0, n, s);
+	act_sigmoid(s, NULL, n);
+	for (i=0; i<n; i++) {
+	    x = gsl_matrix_const_ptr(X, t0+i-1, 0);
+	    xprev = x[trg];
+	    // prediction and error
+	    p = T ? a * s[i] + (1. - a) * xprev : s[i];
+	    e = gsl_matrix_get(X, t0+i, trg) - p;
+	    sdiff += e * e;
+	    if (!grad)
+		continue;
+	    // derivatives of the squared error
+	    g = -2. * e;
+	    du = g * a * s[i] * (1. - s[i]);
+	    if (reg)
+		for (k=0; k<nregs; k++)
+		    grad[k] += du * x[reg[k]];
+	    else
+		for (k=0; k<nregs; k++)
+		    grad[k] += du * x[k];
+	    grad[nregs] += du;
+	    // d(a)/dT = -a / T
+	    if (T)
+		grad[nregs+1] -= g * (s[i] - xprev) * a / *T;
+	}
+    }
+
+    if (grad)
+	for (k=0; k<nregs+(T ? 2 : 1); k++)
+	    grad[k] /= tpoints;
+
+    return sdiff / tpoints;
+
+}
+
+
+
+double predict_mse(const gsl_matrix *X, const gsl_matrix *P) {
+
+    size_t t, i;
+    size_t tpoints = X->size1;
+    size_t nodes = X->size2;
+    const double *x, *p;
+    double diff, sdiff = 0;
+
+    for (t=0; t<tpoints; t++) {
+	x = gsl_matrix_const_ptr(X, t, 0);
+	p = gsl_matrix_const_ptr(P, t, 0);
+	for (i=0; i<nodes; i++) {
+	    diff = x[i] - p[i];
+	    sdiff += diff * diff;
+	}
+    }
+
+    return sdiff / (tpoints * nodes);
+
+}
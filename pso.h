@@ -26,6 +26,7 @@
 // CONSTANTS
 #define PSO_MAX_SIZE 150 // max swarm size
 #define PSO_INERTIA 0.7298 // default value of w (see clerc02)
+#define PSO_ALIGN 64 // alignment of the workspace arrays (bytes)
 
 
 // === NEIGHBORHOOD SCHEMES ===
@@ -48,15 +49,61 @@
 
 
 
+// === STAGNATION STRATEGIES ===
+
+// stop the optimization
+#define PSO_STALL_STOP 0
+
+// re-seed part of the swarm (see restart_frac) and continue
+#define PSO_STALL_RESTART 1
+
+
+
 // PSO SOLUTION -- Initialized by the user
 typedef struct {
     double error;
     double *gbest; // should contain DIM elements!!
+    int steps; // number of steps actually performed (set by PSO)
+    int restarts; // number of partial restarts (set by PSO)
+    long evals; // number of objective function evaluations (set by PSO)
 } pso_result_t;
 
 
+// PSO WORKSPACE -- holds the particles and the swarm
+// the arrays are allocated on the heap (aligned to PSO_ALIGN) and
+// grow as needed, so a workspace can be reused across many runs;
+// a workspace must not be used by two runs at the same time
+typedef struct {
+
+    double *pos; // position matrix (size x dim)
+    double *vel; // velocity matrix (size x dim)
+    double *pos_b; // best position matrix (size x dim)
+    double *pos_nb; // best informed position matrix (size x dim)
+    double *fit; // particle fitness vector (size)
+    double *fit_b; // best fitness vector (size)
+    int *comm; // communications matrix (size x size)
+    double *rho1, *rho2; // random coefficients of a particle (dim)
+
+    size_t cap_n; // capacity of the matrices (elements)
+    int cap_size; // capacity of the vectors (elements)
+    int cap_dim; // capacity of the coefficient vectors (elements)
+
+} pso_workspace_t;
+
+
 typedef double (*pso_obj_fun_t)(double *, size_t, void *);
 
+// objective function that may abandon the evaluation of a position
+// as soon as its value is known to exceed the cutoff (the particle's
+// personal best); it then returns any value greater than the cutoff
+typedef double (*pso_cutoff_obj_fun_t)(double *, size_t, double, void *);
+
+// objective function that evaluates the whole swarm at once
+// (positions of count particles stored row-wise, count x dim)
+// and stores the fitness of the i^th particle in fit[i]
+typedef void (*pso_batch_obj_fun_t)(double *pos, int count, size_t dim,
+				    double *fit, void *params);
+
 
 
 // PSO SETTINGS
@@ -85,10 +132,49 @@ typedef struct {
     gsl_rng *rng; // pointer to RNG
     long seed; // seed for the generator
 
+    // stagnation :: either no relative improvement (stall_tol) of the
+    // error over stall_steps steps, or a swarm diameter (relative to
+    // the search range) below min_diameter
+    int stall_steps; // stagnation window (0 : off)
+    double stall_tol; // minimum relative improvement within the window
+    double min_diameter; // minimum swarm diameter (0 : off)
+    int stall_strategy; // what to do on stagnation (stop or restart)
+    double restart_frac; // fraction of the swarm re-seeded on restart
+
+    // warm start :: the first n_seeds particles of the initial swarm
+    // start at the seed positions instead of random positions
+    // (the generated random numbers are the same in any case)
+    double *seeds; // seed positions (n_seeds x dim, row-wise)
+    int n_seeds; // number of seed positions (at most size)
+
+    int threads; // number of threads that evaluate the swarm
+                 // (the objective function must be re-entrant)
+
+    pso_workspace_t *workspace; // NULL : use the default workspace
+                                // of the calling thread
+
 } pso_settings_t;
 
 
 
+// allocate/free a (empty) workspace
+pso_workspace_t *pso_workspace_alloc(void);
+void pso_workspace_free(pso_workspace_t *ws);
+
+// make sure that ws can hold a swarm of size particles in dim dimensions
+void pso_workspace_reserve(pso_workspace_t *ws, int size, int dim);
+
+// return the default workspace of the calling thread
+// (allocated on first use and freed when the thread exits)
+pso_workspace_t *pso_default_workspace(void);
+
+// free the default workspace and the evaluation threads (see threads)
+// of the calling thread; both are kept across runs and freed when a
+// thread exits, so only the main thread needs to call this
+void pso_free_thread_state(void);
+
+
+
 // return the swarm size based on dimensionality
 int calc_swarm_size(int dim);
 
@@ -103,6 +189,16 @@ void pso_set_default_settings(pso_settings_t *settings);
 void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 	       pso_result_t *solution, pso_settings_t *settings);
 
+// same as pso_solve, using an objective function with early abandonment
+// (the search trajectory is identical to that of pso_solve)
+void pso_solve_with_cutoff(pso_cutoff_obj_fun_t obj_fun, void *obj_fun_params,
+			   pso_result_t *solution, pso_settings_t *settings);
+
+// same as pso_solve, using an objective function that evaluates
+// all the particles of the swarm in a single call
+void pso_solve_batch(pso_batch_obj_fun_t obj_fun, void *obj_fun_params,
+		     pso_result_t *solution, pso_settings_t *settings);
+
 
 
 
@@ -20,8 +20,12 @@
 #include "pso.h"
 #include <time.h> // for time()
 #include <math.h> // for cos(), pow(), sqrt() etc.
-#include <float.h> // for FLT_MAX
+#include <float.h> // for FLT_MAX, DBL_MAX
 #include <string.h> // for mem*
+#include <stdlib.h> // for calloc(), posix_memalign()
+#include <pthread.h>
+
+#include "simd.h"
 
 
 
@@ -216,37 +220,642 @@ void pso_set_default_settings(pso_settings_t *settings) {
     settings->rng = NULL;
     settings->seed = time(0);
 
+    settings->stall_steps = 0;
+    settings->stall_tol = 1e-6;
+    settings->min_diameter = 0;
+    settings->stall_strategy = PSO_STALL_STOP;
+    settings->restart_frac = 0.5;
+
+    settings->seeds = NULL;
+    settings->n_seeds = 0;
+
+    settings->threads = 1;
+    settings->workspace = NULL;
+
+}
+
+
+
+
+//==============================================================
+//                     PSO WORKSPACE
+//==============================================================
+
+// allocate n elements of the given size, aligned for SIMD
+static void *alloc_aligned(size_t n, size_t size) {
+
+    void *ptr;
+
+    if (posix_memalign(&ptr, PSO_ALIGN, n * size + PSO_ALIGN))
+	return NULL;
+
+    return ptr;
+
+}
+
+
+
+pso_workspace_t *pso_workspace_alloc(void) {
+
+    return calloc(1, sizeof(pso_workspace_t));
+
+}
+
+
+
+void pso_workspace_free(pso_workspace_t *ws) {
+
+    if (!ws)
+	return;
+
+    free(ws->pos);
+    free(ws->vel);
+    free(ws->pos_b);
+    free(ws->pos_nb);
+    free(ws->fit);
+    free(ws->fit_b);
+    free(ws->comm);
+    free(ws->rho1);
+    free(ws->rho2);
+    free(ws);
+
+}
+
+
+
+void pso_workspace_reserve(pso_workspace_t *ws, int size, int dim) {
+
+    size_t n = (size_t)size * dim;
+
+    // the matrices hold size x dim elements (fit and comm depend on 
+    // the swarm size only)
+    if (n > ws->cap_n) {
+	free(ws->pos);
+	free(ws->vel);
+	free(ws->pos_b);
+	free(ws->pos_nb);
+	ws->pos = alloc_aligned(n, sizeof(double));
+	ws->vel = alloc_aligned(n, sizeof(double));
+	ws->pos_b = alloc_aligned(n, sizeof(double));
+	ws->pos_nb = alloc_aligned(n, sizeof(double));
+	ws->cap_n = n;
+    }
+
+    if (dim > ws->cap_dim) {
+	free(ws->rho1);
+	free(ws->rho2);
+	ws->rho1 = alloc_aligned(dim, sizeof(double));
+	ws->rho2 = alloc_aligned(dim, sizeof(double));
+	ws->cap_dim = dim;
+    }
+
+    if (size > ws->cap_size) {
+	free(ws->fit);
+	free(ws->fit_b);
+	free(ws->comm);
+	ws->fit = alloc_aligned(size, sizeof(double));
+	ws->fit_b = alloc_aligned(size, sizeof(double));
+	ws->comm = alloc_aligned((size_t)size * size, sizeof(int));
+	ws->cap_size = size;
+    }
+
+}
+
+
+
+// each thread has its own default workspace (freed at thread exit)
+static pthread_key_t workspace_key;
+static pthread_once_t workspace_once = PTHREAD_ONCE_INIT;
+
+
+static void free_workspace(void *ws) {
+
+    pso_workspace_free(ws);
+
+}
+
+
+static void make_workspace_key(void) {
+
+    pthread_key_create(&workspace_key, free_workspace);
+
+}
+
+
+pso_workspace_t *pso_default_workspace(void) {
+
+    pso_workspace_t *ws;
+
+    pthread_once(&workspace_once, make_workspace_key);
+    ws = pthread_getspecific(workspace_key);
+    if (!ws) {
+	ws = pso_workspace_alloc();
+	pthread_setspecific(workspace_key, ws);
+    }
+
+    return ws;
+
+}
+
+
+
+//==============================================================
+//                  PARTICLE UPDATE KERNELS
+//==============================================================
+
+// v = w * v + rho1 * (pb - p) + rho2 * (nb - p)
+// p = p + v (clamped within [x_lo, x_hi] with v = 0, if requested)
+// NOTE : the SIMD code paths perform exactly the same operations in
+// the same order (no FMA), so all paths agree to the bit
+
+static inline void update_scalar(double *p, double *v, const double *pb,
+				 const double *nb, const double *rho1,
+				 const double *rho2, double w,
+				 int from, pso_settings_t *settings)
+{
+
+    int d;
+
+    for (d=from; d<settings->dim; d++) {
+	// update velocity
+	v[d] = w * v[d] + rho1[d] * (pb[d] - p[d]) + rho2[d] * (nb[d] - p[d]);
+	// update position
+	p[d] += v[d];
+	// clamp position within bounds?
+	if (settings->clamp_pos) {
+	    if (p[d] < settings->x_lo) {
+		p[d] = settings->x_lo;
+		v[d] = 0;
+	    } else if (p[d] > settings->x_hi) {
+		p[d] = settings->x_hi;
+		v[d] = 0;
+	    }
+	}
+    }
+
 }
 
 
+#if SIMD_X86
+
+// the SIMD loops return the number of processed dimensions
+static int update_sse2(double *p, double *v, const double *pb,
+		       const double *nb, const double *rho1,
+		       const double *rho2, double w,
+		       pso_settings_t *settings)
+{
+
+    int d;
+    __m128d pv, vv, out, lo, hi, wv;
+
+    wv = _mm_set1_pd(w);
+    lo = _mm_set1_pd(settings->x_lo);
+    hi = _mm_set1_pd(settings->x_hi);
+    for (d=0; d+2<=settings->dim; d+=2) {
+	pv = _mm_loadu_pd(p + d);
+	vv = _mm_add_pd(_mm_add_pd(_mm_mul_pd(wv, _mm_loadu_pd(v + d)),
+				   _mm_mul_pd(_mm_loadu_pd(rho1 + d),
+					      _mm_sub_pd(_mm_loadu_pd(pb + d), pv))),
+			_mm_mul_pd(_mm_loadu_pd(rho2 + d),
+				   _mm_sub_pd(_mm_loadu_pd(nb + d), pv)));
+	pv = _mm_add_pd(pv, vv);
+	if (settings->clamp_pos) {
+	    // out of bounds :: set position to the bound, zero velocity
+	    out = _mm_or_pd(_mm_cmplt_pd(pv, lo), _mm_cmpgt_pd(pv, hi));
+	    pv = _mm_min_pd(_mm_max_pd(pv, lo), hi);
+	    vv = _mm_andnot_pd(out, vv);
+	}
+	_mm_storeu_pd(p + d, pv);
+	_mm_storeu_pd(v + d, vv);
+    }
+
+    return d;
+
+}
+
+
+static __attribute__((target("avx2")))
+int update_avx2(double *p, double *v, const double *pb,
+		const double *nb, const double *rho1,
+		const double *rho2, double w,
+		pso_settings_t *settings)
+{
+
+    int d;
+    __m256d pv, vv, out, lo, hi, wv;
+
+    wv = _mm256_set1_pd(w);
+    lo = _mm256_set1_pd(settings->x_lo);
+    hi = _mm256_set1_pd(settings->x_hi);
+    for (d=0; d+4<=settings->dim; d+=4) {
+	pv = _mm256_loadu_pd(p + d);
+	vv = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(wv, _mm256_loadu_pd(v + d)),
+					 _mm256_mul_pd(_mm256_loadu_pd(rho1 + d),
+						       _mm256_sub_pd(_mm256_loadu_pd(pb + d), pv))),
+			   _mm256_mul_pd(_mm256_loadu_pd(rho2 + d),
+					 _mm256_sub_pd(_mm256_loadu_pd(nb + d), pv)));
+	pv = _mm256_add_pd(pv, vv);
+	if (settings->clamp_pos) {
+	    // out of bounds :: set position to the bound, zero velocity
+	    out = _mm256_or_pd(_mm256_cmp_pd(pv, lo, _CMP_LT_OQ),
+			       _mm256_cmp_pd(pv, hi, _CMP_GT_OQ));
+	    pv = _mm256_min_pd(_mm256_max_pd(pv, lo), hi);
+	    vv = _mm256_andnot_pd(out, vv);
+	}
+	_mm256_storeu_pd(p + d, pv);
+	_mm256_storeu_pd(v + d, vv);
+    }
+
+    return d;
+
+}
+
+#endif // SIMD_X86
+
+
+// update the velocity and the position of a particle
+static void update_particle(double *p, double *v, const double *pb,
+			    const double *nb, const double *rho1,
+			    const double *rho2, double w,
+			    pso_settings_t *settings)
+{
+
+    int d = 0;
+
+#if SIMD_X86
+    if (simd_level() >= SIMD_AVX2)
+	d = update_avx2(p, v, pb, nb, rho1, rho2, w, settings);
+    else
+	d = update_sse2(p, v, pb, nb, rho1, rho2, w, settings);
+#endif
+
+    // remaining dimensions
+    update_scalar(p, v, pb, nb, rho1, rho2, w, d, settings);
+
+}
+
+
+
+//==============================================================
+//                  STAGNATION HANDLING
+//==============================================================
+
+// the diameter of the swarm around gbest, relative to the search range
+// i.e. max |pos[i][d] - gbest[d]| / (x_hi - x_lo)
+static double calc_diameter(double *pos, double *gbest,
+			    pso_settings_t *settings)
+{
+
+    int i, d;
+    double dist, diam = 0;
+
+    for (i=0; i<settings->size; i++)
+	for (d=0; d<settings->dim; d++) {
+	    dist = fabs(pos[i*settings->dim + d] - gbest[d]);
+	    if (dist > diam)
+		diam = dist;
+	}
+
+    return diam / (settings->x_hi - settings->x_lo);
+
+}
+
+
+// re-initialize the particles with the worst personal bests
+// (a fraction restart_frac of the swarm, never the best particle);
+// their personal bests are forgotten, so the next evaluation sets them
+static void reseed(double *pos, double *vel, double *pos_b,
+		   double *fit_b, pso_settings_t *settings)
+{
+
+    int n = settings->restart_frac * settings->size;
+    int chosen[settings->size];
+    int i, k, d, worst;
+    double a, b;
+
+    if (n > settings->size - 1)
+	n = settings->size - 1;
+
+    memset(chosen, 0, sizeof(int) * settings->size);
+    for (k=0; k<n; k++) {
+	// find the worst particle that has not been chosen yet
+	worst = -1;
+	for (i=0; i<settings->size; i++)
+	    if (!chosen[i] && (worst < 0 || fit_b[i] > fit_b[worst]))
+		worst = i;
+	chosen[worst] = 1;
+	// re-initialize it (as in the swarm initialization)
+	for (d=0; d<settings->dim; d++) {
+	    a = settings->x_lo + (settings->x_hi - settings->x_lo) *	\
+		gsl_rng_uniform(settings->rng);
+	    b = settings->x_lo + (settings->x_hi - settings->x_lo) *	\
+		gsl_rng_uniform(settings->rng);
+	    pos[worst*settings->dim + d] = a;
+	    pos_b[worst*settings->dim + d] = a;
+	    vel[worst*settings->dim + d] = (a-b) / 2.;
+	}
+	fit_b[worst] = DBL_MAX;
+    }
+
+}
+
 
 
 //==============================================================
 //                     PSO ALGORITHM
 //==============================================================
-void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
-	       pso_result_t *solution, pso_settings_t *settings)
+
+// the objective function of a run (exactly one member is not NULL)
+typedef struct {
+    pso_obj_fun_t fun;
+    pso_cutoff_obj_fun_t cutoff_fun;
+    pso_batch_obj_fun_t batch_fun;
+} objective_t;
+
+
+// evaluate the positions of particles from..to-1 (pos) and store the
+// fitness values in fit -- fit_b holds the personal bests (NULL if
+// there are none yet) which are used as cutoffs
+static void evaluate_range(objective_t *obj, void *obj_fun_params,
+			   double *pos, double *fit, double *fit_b,
+			   int from, int to, pso_settings_t *settings)
+{
+
+    int i;
+
+    if (to <= from)
+	return;
+
+    if (obj->batch_fun)
+	// all the particles in one call
+	obj->batch_fun(&pos[from*settings->dim], to - from, settings->dim,
+		       &fit[from], obj_fun_params);
+    else if (obj->cutoff_fun)
+	for (i=from; i<to; i++)
+	    fit[i] = obj->cutoff_fun(&pos[i*settings->dim], settings->dim,
+				     fit_b ? fit_b[i] : DBL_MAX,
+				     obj_fun_params);
+    else
+	for (i=from; i<to; i++)
+	    fit[i] = obj->fun(&pos[i*settings->dim], settings->dim,
+			      obj_fun_params);
+
+}
+
+
+
+//==============================================================
+//          THREAD POOL (for the evaluation of the swarm)
+//==============================================================
+
+// the swarm is split in contiguous chunks of particles, one per
+// worker; the calling thread is worker 0 and evaluates the first chunk
+// NOTE : the objective function must be re-entrant and must not use
+// settings->rng (the fitness values do not depend on the number of
+// threads, so the search trajectory remains the same)
+
+typedef struct pool pool_t;
+
+typedef struct {
+    pool_t *pool;
+    int id; // worker index (1..n-1)
+    pthread_t thread;
+} pool_worker_t;
+
+struct pool {
+    int n; // number of workers (including the calling thread)
+    pool_worker_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv; // signals a new job (or quit)
+    pthread_cond_t done_cv; // signals the completion of a job
+    int job; // job counter
+    int pending; // number of workers still busy with the current job
+    int quit; // whether the workers should exit
+    // the current job
+    objective_t *obj;
+    void *obj_fun_params;
+    double *pos, *fit, *fit_b;
+    pso_settings_t *settings;
+};
+
+
+// evaluate the chunk of the swarm that corresponds to worker id
+static void pool_run_chunk(pool_t *pool, int id) {
+
+    int size = pool->settings->size;
+
+    evaluate_range(pool->obj, pool->obj_fun_params,
+		   pool->pos, pool->fit, pool->fit_b,
+		   id * size / pool->n, (id + 1) * size / pool->n,
+		   pool->settings);
+
+}
+
+
+static void *pool_worker(void *arg) {
+
+    pool_worker_t *worker = arg;
+    pool_t *pool = worker->pool;
+    int job = 0; // the last job of this worker
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+	// wait for a new job
+	while (pool->job == job && !pool->quit)
+	    pthread_cond_wait(&pool->work_cv, &pool->lock);
+	if (pool->quit)
+	    break;
+	job = pool->job;
+	pthread_mutex_unlock(&pool->lock);
+
+	pool_run_chunk(pool, worker->id);
+
+	pthread_mutex_lock(&pool->lock);
+	// am I the last one??
+	if (--pool->pending == 0)
+	    pthread_cond_signal(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+
+}
+
+
+// create a pool of n workers (NULL if n < 2)
+static pool_t *pool_create(int n) {
+
+    pool_t *pool;
+    int i;
+
+    if (n < 2)
+	return NULL;
+
+    pool = calloc(1, sizeof(pool_t));
+    pool->n = n;
+    pool->workers = calloc(n, sizeof(pool_worker_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+    for (i=1; i<n; i++) {
+	pool->workers[i].pool = pool;
+	pool->workers[i].id = i;
+	pthread_create(&pool->workers[i].thread, NULL, 
+		       pool_worker, &pool->workers[i]);
+    }
+
+    return pool;
+
+}
+
+
+static void pool_destroy(pool_t *pool) {
+
+    int i;
+
+    if (!pool)
+	return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+    for (i=1; i<pool->n; i++)
+	pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    free(pool->workers);
+    free(pool);
+
+}
+
+
+// each thread keeps its pool across runs (destroyed at thread exit)
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+
+static void free_pool(void *pool) {
+
+    pool_destroy(pool);
+
+}
+
+
+static void make_pool_key(void) {
+
+    pthread_key_create(&pool_key, free_pool);
+
+}
+
+
+// return the pool of the calling thread with n workers (NULL if n < 2)
+static pool_t *thread_pool(int n) {
+
+    pool_t *pool;
+
+    if (n < 2)
+	return NULL;
+
+    pthread_once(&pool_once, make_pool_key);
+    pool = pthread_getspecific(pool_key);
+    // a different number of workers :: start over
+    if (!pool || pool->n != n) {
+	pool_destroy(pool);
+	pool = pool_create(n);
+	pthread_setspecific(pool_key, pool);
+    }
+
+    return pool;
+
+}
+
+
+void pso_free_thread_state(void) {
+
+    pthread_once(&workspace_once, make_workspace_key);
+    pso_workspace_free(pthread_getspecific(workspace_key));
+    pthread_setspecific(workspace_key, NULL);
+
+    pthread_once(&pool_once, make_pool_key);
+    pool_destroy(pthread_getspecific(pool_key));
+    pthread_setspecific(pool_key, NULL);
+
+}
+
+
+
+// evaluate the positions of all particles (pos) and store the fitness
+// values in fit (using the pool, if any) -- see evaluate_range()
+static void evaluate(objective_t *obj, void *obj_fun_params,
+		     double *pos, double *fit, double *fit_b,
+		     pool_t *pool, pso_settings_t *settings)
+{
+
+    if (!pool) {
+	evaluate_range(obj, obj_fun_params, pos, fit, fit_b,
+		       0, settings->size, settings);
+	return;
+    }
+
+    // post the job
+    pthread_mutex_lock(&pool->lock);
+    pool->obj = obj;
+    pool->obj_fun_params = obj_fun_params;
+    pool->pos = pos;
+    pool->fit = fit;
+    pool->fit_b = fit_b;
+    pool->settings = settings;
+    pool->pending = pool->n - 1;
+    pool->job += 1;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    // evaluate the first chunk
+    pool_run_chunk(pool, 0);
+
+    // wait for the rest
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending)
+	pthread_cond_wait(&pool->done_cv, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+}
+
+
+
+static void solve(objective_t *obj, void *obj_fun_params,
+		  pso_result_t *solution, pso_settings_t *settings)
 {
 
     int free_rng = 0; // whether to free settings->rng when finished
+    pool_t *pool; // evaluation threads (NULL for none)
+    // the workspace that holds the particles and the swarm
+    pso_workspace_t *ws = settings->workspace ? 
+	settings->workspace : pso_default_workspace();
+    pso_workspace_reserve(ws, settings->size, settings->dim);
     // Particles
-    double pos[settings->size][settings->dim]; // position matrix
-    double vel[settings->size][settings->dim]; // velocity matrix
-    double pos_b[settings->size][settings->dim]; // best position matrix
-    double fit[settings->size]; // particle fitness vector
-    double fit_b[settings->size]; // best fitness vector
+    double (*pos)[settings->dim] = (void *)ws->pos; // position matrix
+    double (*vel)[settings->dim] = (void *)ws->vel; // velocity matrix
+    double (*pos_b)[settings->dim] = (void *)ws->pos_b; // best position matrix
+    double *fit = ws->fit; // particle fitness vector
+    double *fit_b = ws->fit_b; // best fitness vector
     // Swarm
-    double pos_nb[settings->size][settings->dim]; // what is the best informed
+    double (*pos_nb)[settings->dim] = (void *)ws->pos_nb; // what is the best informed
                                                // position for each particle
-    int comm[settings->size][settings->size]; // communications:who informs who
+    int (*comm)[settings->size] = (void *)ws->comm; // communications:who informs who
                                             // rows : those who inform
                                             // cols : those who are informed
     int improved = 0; // whether solution->error was improved during
                       // the last iteration
 
     int i, d, step;
+    double stall_err; // the error at the start of the stagnation window
+    int stall_step; // the step at the start of the stagnation window
     double a, b; // for matrix initialization
-    double rho1, rho2; // random numbers (coefficients)
+    double *rho1 = ws->rho1, *rho2 = ws->rho2; // random coefficients
     double w; // current omega
     void (*inform_fun)(); // neighborhood update function
     double (*calc_inertia_fun)(); // inertia weight update function
@@ -264,6 +873,10 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 	free_rng = 1;
     }
 
+    // GET THE THREAD POOL (if requested)
+    pool = thread_pool(settings->threads < settings->size ? 
+		       settings->threads : settings->size);
+
     // SELECT APPROPRIATE NHOOD UPDATE FUNCTION
     switch (settings->nhood_strategy)
 	{
@@ -294,6 +907,9 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 
     // INITIALIZE SOLUTION
     solution->error = FLT_MAX;
+    solution->steps = 0;
+    solution->restarts = 0;
+    solution->evals = 0;
     
     // SWARM INITIALIZATION
     // for each particle
@@ -305,15 +921,28 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 		gsl_rng_uniform(settings->rng);
 	    b = settings->x_lo + (settings->x_hi - settings->x_lo) *	\
 		gsl_rng_uniform(settings->rng);
-	    // initialize position
-	    pos[i][d] = a;
+	    // initialize position (the first particles start at
+	    // the seed positions, if any)
+	    if (i < settings->n_seeds) {
+		pos[i][d] = settings->seeds[i*settings->dim + d];
+		if (settings->clamp_pos)
+		    pos[i][d] = (pos[i][d] < settings->x_lo) ? settings->x_lo :
+			(pos[i][d] > settings->x_hi) ? settings->x_hi : pos[i][d];
+	    } else
+		pos[i][d] = a;
 	    // best position is the same
-	    pos_b[i][d] = a;
+	    pos_b[i][d] = pos[i][d];
 	    // initialize velocity
 	    vel[i][d] = (a-b) / 2.;
 	}
-	// update particle fitness
-	fit[i] = obj_fun(pos[i], settings->dim, obj_fun_params);
+    }
+
+    // update particle fitness (there is no personal best yet)
+    evaluate(obj, obj_fun_params, &pos[0][0], fit, NULL, pool, settings);
+    solution->evals += settings->size;
+
+    // for each particle
+    for (i=0; i<settings->size; i++) {
 	fit_b[i] = fit[i]; // this is also the personal best
 	// update gbest??
 	if (fit[i] < solution->error) {
@@ -326,6 +955,10 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 	
     }
 
+    // initialize stagnation window
+    stall_err = solution->error;
+    stall_step = 0;
+
     // initialize omega using standard value
     w = PSO_INERTIA;
     // RUN ALGORITHM
@@ -352,32 +985,27 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 
 	// update all particles
 	for (i=0; i<settings->size; i++) {
-	    // for each dimension
+	    // calculate stochastic coefficients for all dimensions
+	    // (in the same order as a per-dimension loop would)
 	    for (d=0; d<settings->dim; d++) {
-		// calculate stochastic coefficients
-		rho1 = settings->c1 * gsl_rng_uniform(settings->rng);
-		rho2 = settings->c2 * gsl_rng_uniform(settings->rng);
-		// update velocity
-		vel[i][d] = w * vel[i][d] +	\
-		    rho1 * (pos_b[i][d] - pos[i][d]) +	\
-		    rho2 * (pos_nb[i][d] - pos[i][d]);
-		// update position
-		pos[i][d] += vel[i][d];
-		// clamp position within bounds?
-		if (settings->clamp_pos) {
-		    if (pos[i][d] < settings->x_lo) {
-			pos[i][d] = settings->x_lo;
-			vel[i][d] = 0;
-		    } else if (pos[i][d] > settings->x_hi) {
-			pos[i][d] = settings->x_hi;
-			vel[i][d] = 0;
-		    }
-		}
-		    
+		rho1[d] = settings->c1 * gsl_rng_uniform(settings->rng);
+		rho2[d] = settings->c2 * gsl_rng_uniform(settings->rng);
 	    }
-	    
-	    // update particle fitness
-	    fit[i] = obj_fun(pos[i], settings->dim, obj_fun_params);
+	    // update velocity and position (and clamp position)
+	    update_particle(pos[i], vel[i], pos_b[i], pos_nb[i],
+			    rho1, rho2, w, settings);
+	}
+
+	// update particle fitness
+	// an abandoned evaluation exceeds fit_b[i] (>= solution->error)
+	// so it can not update any of the bests below
+	evaluate(obj, obj_fun_params, &pos[0][0], fit, fit_b, pool, settings);
+	solution->evals += settings->size;
+
+	// update the bests (in particle order)
+	// NOTE : the movement of the particles does not depend on the
+	// bests of this step (pos_nb is updated before the loop above)
+	for (i=0; i<settings->size; i++) {
 	    // update personal best position?
 	    if (fit[i] < fit_b[i]) {
 		fit_b[i] = fit[i];
@@ -396,8 +1024,34 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 	    }
 	}
 
+	// one more step done
+	solution->steps = step + 1;
+
 	if (settings->print_every && (step % settings->print_every == 0))
 	    printf("Step %d (w=%.2f) :: min err=%.10e\n", step, w, solution->error);
+
+	// CHECK STAGNATION
+	// relative improvement of the error since the reference step?
+	if (stall_err - solution->error > 
+	    settings->stall_tol * fabs(stall_err)) {
+	    stall_err = solution->error;
+	    stall_step = step;
+	}
+	if ((settings->stall_steps && 
+	     step - stall_step >= settings->stall_steps) ||
+	    (settings->min_diameter > 0 &&
+	     calc_diameter(&pos[0][0], solution->gbest, settings) < 
+	     settings->min_diameter)) {
+	    if (settings->print_every)
+		printf("Stagnation @ step %d\n", step);
+	    if (settings->stall_strategy == PSO_STALL_STOP)
+		break;
+	    // re-seed part of the swarm and start a new window
+	    reseed(&pos[0][0], &vel[0][0], &pos_b[0][0], fit_b, settings);
+	    solution->restarts += 1;
+	    stall_err = solution->error;
+	    stall_step = step;
+	}
 	
     }
 
@@ -408,6 +1062,39 @@ void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
 
 
 
+void pso_solve(pso_obj_fun_t obj_fun, void *obj_fun_params,
+	       pso_result_t *solution, pso_settings_t *settings)
+{
+
+    objective_t obj = {obj_fun, NULL, NULL};
+    solve(&obj, obj_fun_params, solution, settings);
+
+}
+
+
+
+void pso_solve_with_cutoff(pso_cutoff_obj_fun_t obj_fun, void *obj_fun_params,
+			   pso_result_t *solution, pso_settings_t *settings)
+{
+
+    objective_t obj = {NULL, obj_fun, NULL};
+    solve(&obj, obj_fun_params, solution, settings);
+
+}
+
+
+
+void pso_solve_batch(pso_batch_obj_fun_t obj_fun, void *obj_fun_params,
+		     pso_result_t *solution, pso_settings_t *settings)
+{
+
+    objective_t obj = {NULL, NULL, obj_fun};
+    solve(&obj, obj_fun_params, solution, settings);
+
+}
+
+
+
 
 
 
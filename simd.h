@@ -0,0 +1,43 @@
+/* Runtime selection of SIMD code paths
+
+   SIMD kernels are compiled for x86-64 with gcc/clang only; SSE2 is
+   part of the x86-64 baseline, AVX2 is detected at runtime and used
+   through functions compiled with __attribute__((target("avx2"))).
+   All the kernels avoid FMA contractions, so that the scalar, SSE2 and
+   AVX2 code paths produce bit-identical results.
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+
+// SIMD LEVELS
+#define SIMD_NONE 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+
+
+// return the best SIMD level supported by the running CPU
+static inline int simd_level(void) {
+
+#if SIMD_X86
+    static int level = -1;
+    if (level < 0)
+	level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE2;
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+
+}
+
+
+#endif // SIMD_H_
@@ -0,0 +1,110 @@
+#import  <Foundation/Foundation.h>
+#import "GSL.h"
+#import "Graph.h"
+
+
+/*
+  Trace of the ACO simulation (see --trace)
+
+  The trace records every ant (its graph, the per-target errors of its
+  evaluation, the number of PSO objective evaluations and the time it
+  took) and the pheromone matrix at the end of every step. It is a
+  binary file (TRACE_FILE in log_path, in the byte order of the host)
+  that can be mapped into memory and read in place; netinf_trace dumps
+  it as text.
+
+  The records are appended to a memory buffer and a background thread
+  writes the full buffers to the file, so that tracing never waits for
+  the disk (unless the disk falls behind by a whole buffer); the
+  checkpoints wait for the records so far (see trace_flush()).
+
+  Layout (all sizes in bytes; every record starts at a multiple of 8) :
+
+  ** header (16) : char magic[8] (TRACE_MAGIC), int32 nodes, int32 ants
+  ** record : int32 type, int32 size (of the whole record), followed by
+     ** TRACE_ANT : int32 step, int32 ant, int32 edges, int32 flags,
+	int64 evals, double seconds, double errors[nodes],
+	int32 (from, to) pairs[edges] (in target-major order), padding
+     ** TRACE_PHERO : int32 step, int32 (unused),
+	double phero[nodes * nodes] (row-major)
+
+  The evals and the seconds of an ant are -1 when they are not known
+  (graphs evaluated by worker processes) and 0 for duplicates.
+
+  The size of a record is an int32, so the trace supports graphs of up
+  to about 16000 nodes (see trace_open()).
+ */
+
+
+#define TRACE_MAGIC "NETINFT1"
+
+// record types
+#define TRACE_ANT 1
+#define TRACE_PHERO 2
+
+// ant flags
+#define TRACE_DUPLICATE 1 // the graph was not evaluated (see GraphCache)
+
+
+// the header of the file
+typedef struct {
+
+  char magic[8];
+  int32_t nodes;
+  int32_t ants;
+
+} trace_header_t;
+
+
+// the header of a record
+typedef struct {
+
+  int32_t type;
+  int32_t size;
+
+} trace_record_t;
+
+
+// the fixed part of an ant record (followed by the errors and the edges)
+typedef struct {
+
+  int32_t step;
+  int32_t ant;
+  int32_t edges;
+  int32_t flags;
+  int64_t evals;
+  double seconds;
+
+} trace_ant_t;
+
+
+// the fixed part of a pheromone record (followed by the matrix)
+typedef struct {
+
+  int32_t step;
+  int32_t unused;
+
+} trace_phero_t;
+
+
+// create the trace file and start the writer thread
+// (step : the first step of the run; on --resume the records of the
+// steps before it in an existing trace are kept and the rest dropped,
+// and the trace must hold the pheromones of step - 1)
+// returns 0 on success
+int trace_open(int step);
+
+// append the record of an ant (may be called by several threads)
+void trace_ant(int step, int ant, Digraph *g, GSLVector *errors,
+	       long evals, double seconds, int flags);
+
+// append the pheromone matrix at the end of a step
+void trace_phero(int step, GSLMatrix *phero);
+
+// write the records so far to the disk (before a checkpoint, so that
+// a resumed run finds the trace of the steps it skips)
+// returns 0 on success
+int trace_flush(void);
+
+// write the remaining records, stop the writer and close the file
+void trace_close(void);
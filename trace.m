@@ -0,0 +1,332 @@
+#import "trace.h"
+#import "params.h"
+
+#import <pthread.h>
+#import <string.h>
+#import <unistd.h>
+#import <sys/stat.h>
+
+
+// the size of each of the two buffers (grows for larger records)
+#define TRACE_BUFFER (1 << 20)
+
+// round up to a multiple of 8
+#define ALIGN8(X) (((X) + 7) & ~(size_t)7)
+
+
+// the state of the writer :: the records are appended to buf[cur];
+// a full buffer is handed to the writer thread (pending bytes) and
+// the other one is filled in the meantime
+static FILE *file = NULL;
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cv = PTHREAD_COND_INITIALIZER; // pending or stop changed
+static char *buf[2];
+static size_t cap[2];
+static int cur = 0;
+static size_t len = 0; // the bytes of buf[cur]
+static size_t pending = 0; // the bytes of buf[1-cur] to write (0 : none)
+static BOOL stop = NO;
+static BOOL failed = NO;
+
+
+
+//=================================================================
+//          WRITER THREAD
+//=================================================================
+
+static void *write_buffers(void *arg) {
+
+  size_t n;
+  char *b;
+
+  pthread_mutex_lock(&lock);
+  while (1) {
+    while (!pending && !stop)
+      pthread_cond_wait(&cv, &lock);
+    if (pending) {
+      // write the full buffer without holding the lock
+      b = buf[1 - cur];
+      n = pending;
+      pthread_mutex_unlock(&lock);
+      if (fwrite(b, 1, n, file) != n && !failed) {
+	failed = YES;
+	fprintf(stderr, "Error writing the trace\n");
+      }
+      pthread_mutex_lock(&lock);
+      pending = 0;
+      pthread_cond_broadcast(&cv);
+    } else
+      break;
+  }
+  pthread_mutex_unlock(&lock);
+
+  return NULL;
+
+}
+
+
+
+// hand buf[cur] to the writer and switch to the other buffer
+// (called with the lock held)
+static void swap_buffers(void) {
+
+  // the writer must be done with the other buffer
+  while (pending)
+    pthread_cond_wait(&cv, &lock);
+
+  pending = len;
+  cur = 1 - cur;
+  len = 0;
+  pthread_cond_broadcast(&cv);
+
+}
+
+
+
+// reserve size bytes at the end of the current buffer
+// (called with the lock held)
+static char *reserve(size_t size) {
+
+  char *p;
+
+  if (len + size > cap[cur]) {
+    swap_buffers();
+    if (size > cap[cur]) {
+      cap[cur] = size;
+      buf[cur] = realloc(buf[cur], size);
+    }
+  }
+
+  p = buf[cur] + len;
+  len += size;
+
+  return p;
+
+}
+
+
+
+//=================================================================
+//          RECORDS
+//=================================================================
+
+// open the trace of an interrupted run that resumes at step, keeping
+// the records of the earlier steps and dropping the rest (NULL if the
+// trace does not exist or does not match the settings)
+static FILE *reopen(const char *path, int step) {
+
+  FILE *f = fopen(path, "r+b");
+  trace_header_t hdr;
+  trace_record_t rec;
+  int32_t rstep, phero = -1;
+  struct stat st;
+  off_t off = sizeof(hdr);
+
+  if (!f)
+    return NULL;
+
+  if (fstat(fileno(f), &st) ||
+      fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+      memcmp(hdr.magic, TRACE_MAGIC, 8) ||
+      hdr.nodes != settings.nodes || hdr.ants != settings.aco_ants) {
+    fclose(f);
+    return NULL;
+  }
+
+  // skip the complete records of the earlier steps (both types of
+  // records start with their step)
+  while (fseeko(f, off, SEEK_SET) == 0 &&
+	 fread(&rec, sizeof(rec), 1, f) == 1 &&
+	 rec.size >= (int32_t)(sizeof(rec) + sizeof(rstep)) &&
+	 off + rec.size <= st.st_size &&
+	 fread(&rstep, sizeof(rstep), 1, f) == 1 &&
+	 rstep < step) {
+    if (rec.type == TRACE_PHERO)
+      phero = rstep;
+    off += rec.size;
+  }
+
+  // the kept records must end with the last step before the checkpoint
+  if (phero != step - 1 ||
+      ftruncate(fileno(f), off) || fseeko(f, off, SEEK_SET)) {
+    fclose(f);
+    return NULL;
+  }
+
+  return f;
+
+}
+
+
+
+int trace_open(int step) {
+
+  NSString *path = [settings.log_path stringByAppendingPathComponent:TRACE_FILE];
+  trace_header_t hdr;
+  // the largest record : an ant with all the edges
+  uint64_t max = sizeof(trace_record_t) + sizeof(trace_ant_t) +
+    sizeof(double) * (uint64_t)settings.nodes +
+    sizeof(int32_t) * 2 * (uint64_t)settings.nodes * settings.nodes;
+
+  // the sizes of the records are int32
+  if (max > INT32_MAX) {
+    fprintf(stderr, "The trace does not support %d nodes\n", settings.nodes);
+    return -1;
+  }
+
+  // continue the trace of an interrupted run??
+  if (settings.resume && step > 0 &&
+      access([path UTF8String], F_OK) == 0) {
+    file = reopen([path UTF8String], step);
+    if (!file) {
+      fprintf(stderr, "The trace %s does not match the settings\n", [path UTF8String]);
+      return -1;
+    }
+  } else {
+    file = fopen([path UTF8String], "wb");
+    if (!file) {
+      fprintf(stderr, "Can not create the trace %s\n", [path UTF8String]);
+      return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, 8);
+    hdr.nodes = settings.nodes;
+    hdr.ants = settings.aco_ants;
+    if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+      fclose(file);
+      file = NULL;
+      return -1;
+    }
+  }
+
+  cap[0] = cap[1] = TRACE_BUFFER;
+  buf[0] = malloc(cap[0]);
+  buf[1] = malloc(cap[1]);
+  cur = 0;
+  len = pending = 0;
+  stop = failed = NO;
+
+  if (pthread_create(&writer, NULL, write_buffers, NULL)) {
+    perror("pthread_create");
+    free(buf[0]);
+    free(buf[1]);
+    fclose(file);
+    file = NULL;
+    return -1;
+  }
+
+  return 0;
+
+}
+
+
+
+void trace_ant(int step, int ant, Digraph *g, GSLVector *errors,
+	       long evals, double seconds, int flags)
+{
+
+  const cgraph_t *c = [g compact];
+  size_t size = ALIGN8(sizeof(trace_record_t) + sizeof(trace_ant_t) +
+		       sizeof(double) * settings.nodes +
+		       sizeof(int32_t) * 2 * c->edges);
+  trace_record_t rec = {TRACE_ANT, size};
+  trace_ant_t a = {step, ant, c->edges, flags, evals, seconds};
+  int32_t *pairs;
+  double *err;
+  char *p;
+  int i;
+
+  if (!file)
+    return;
+
+  pthread_mutex_lock(&lock);
+  p = reserve(size);
+  memcpy(p, &rec, sizeof(rec));
+  memcpy(p + sizeof(rec), &a, sizeof(a));
+  err = (double *)(p + sizeof(rec) + sizeof(a));
+  for (i=0; i<settings.nodes; i++)
+    err[i] = [errors valueAtIndex:i];
+  pairs = (int32_t *)(err + settings.nodes);
+  for (i=0; i<c->edges; i++) {
+    pairs[2*i] = c->in[i];
+    pairs[2*i+1] = c->trg[i];
+  }
+  // the padding
+  memset(pairs + 2 * c->edges, 0, p + size - (char *)(pairs + 2 * c->edges));
+  pthread_mutex_unlock(&lock);
+
+}
+
+
+
+void trace_phero(int step, GSLMatrix *phero) {
+
+  const gsl_matrix *m = [phero matrix];
+  size_t size = sizeof(trace_record_t) + sizeof(trace_phero_t) +
+    sizeof(double) * m->size1 * m->size2;
+  trace_record_t rec = {TRACE_PHERO, size};
+  trace_phero_t ph = {step, 0};
+  double *v;
+  char *p;
+  int i;
+
+  if (!file)
+    return;
+
+  pthread_mutex_lock(&lock);
+  p = reserve(size);
+  memcpy(p, &rec, sizeof(rec));
+  memcpy(p + sizeof(rec), &ph, sizeof(ph));
+  // the rows of the matrix
+  v = (double *)(p + sizeof(rec) + sizeof(ph));
+  for (i=0; i<m->size1; i++)
+    memcpy(v + i * m->size2, m->data + i * m->tda, sizeof(double) * m->size2);
+  pthread_mutex_unlock(&lock);
+
+}
+
+
+
+int trace_flush(void) {
+
+  BOOL ok;
+
+  if (!file)
+    return 0;
+
+  // hand over the current buffer and wait for the writer
+  pthread_mutex_lock(&lock);
+  swap_buffers();
+  while (pending)
+    pthread_cond_wait(&cv, &lock);
+  ok = !failed && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  pthread_mutex_unlock(&lock);
+
+  return ok ? 0 : -1;
+
+}
+
+
+
+void trace_close(void) {
+
+  if (!file)
+    return;
+
+  // hand over the last buffer and stop the writer
+  pthread_mutex_lock(&lock);
+  swap_buffers();
+  stop = YES;
+  pthread_cond_broadcast(&cv);
+  pthread_mutex_unlock(&lock);
+  pthread_join(writer, NULL);
+
+  if (fclose(file) && !failed)
+    fprintf(stderr, "Error writing the trace\n");
+  file = NULL;
+  free(buf[0]);
+  free(buf[1]);
+
+}
@@ -0,0 +1,171 @@
+/* netinf_trace : dump a trace of netinf (see trace.h) as text
+
+   Usage : netinf_trace [-a] TRACE
+
+   Prints one line per record to stdout :
+
+   ant STEP ANT FLAGS EVALS SECONDS ERRORS... - FROM:TO ...
+   phero STEP VALUES... (the matrix, row by row)
+
+   ** -a : print only the ants (no pheromone matrices)
+
+   The file is mapped into memory and the records are read in place.
+ */
+
+#import <Foundation/Foundation.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <string.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+
+#import "trace.h"
+
+
+// round up to a multiple of 8 (see trace.m)
+#define ALIGN8(X) (((X) + 7) & ~(int64_t)7)
+
+
+static void print_help(void) {
+
+  printf("Usage : netinf_trace [-a] TRACE\n");
+  printf("  -a : print only the ants (no pheromone matrices)\n");
+
+}
+
+
+
+// the size that a record of nodes must have (-1 : invalid), so that
+// no read goes past the record
+static int64_t record_size(const trace_record_t *rec, int nodes) {
+
+  const trace_ant_t *a = (const trace_ant_t *)(rec + 1);
+  int64_t size;
+
+  switch (rec->type) {
+  case TRACE_ANT:
+    // the fixed part holds the number of edges
+    size = sizeof(trace_record_t) + sizeof(trace_ant_t);
+    if (rec->size < size || a->edges < 0 || a->edges > (int64_t)nodes * nodes)
+      return -1;
+    return ALIGN8(size + sizeof(double) * (int64_t)nodes +
+		  sizeof(int32_t) * 2 * (int64_t)a->edges);
+  case TRACE_PHERO:
+    return sizeof(trace_record_t) + sizeof(trace_phero_t) +
+      sizeof(double) * (int64_t)nodes * nodes;
+  default:
+    // the records of other types are skipped
+    return rec->size;
+  }
+
+}
+
+
+
+static void dump_ant(const char *p, int nodes) {
+
+  const trace_ant_t *a = (const trace_ant_t *)p;
+  const double *err = (const double *)(a + 1);
+  const int32_t *pairs = (const int32_t *)(err + nodes);
+  int i;
+
+  printf("ant %d %d %d %lld %g", a->step, a->ant, a->flags,
+	 (long long)a->evals, a->seconds);
+  for (i=0; i<nodes; i++)
+    printf(" %g", err[i]);
+  printf(" -");
+  for (i=0; i<a->edges; i++)
+    printf(" %d:%d", pairs[2*i], pairs[2*i+1]);
+  printf("\n");
+
+}
+
+
+
+static void dump_phero(const char *p, int nodes) {
+
+  const trace_phero_t *ph = (const trace_phero_t *)p;
+  const double *v = (const double *)(ph + 1);
+  int i;
+
+  printf("phero %d", ph->step);
+  for (i=0; i<nodes*nodes; i++)
+    printf(" %g", v[i]);
+  printf("\n");
+
+}
+
+
+
+int main(int argc, char **argv) {
+
+  BOOL ants_only = NO;
+  const trace_header_t *hdr;
+  const trace_record_t *rec;
+  struct stat st;
+  size_t off;
+  char *data;
+  int fd, opt;
+
+  while ((opt = getopt(argc, argv, "ah")) != -1)
+    switch (opt) {
+    case 'a':
+      ants_only = YES;
+      break;
+    default:
+      print_help();
+      return 1;
+    }
+
+  if (optind != argc - 1) {
+    print_help();
+    return 1;
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if (fd < 0 || fstat(fd, &st)) {
+    fprintf(stderr, "Can not open the trace %s\n", argv[optind]);
+    return 1;
+  }
+  if (st.st_size < sizeof(trace_header_t)) {
+    fprintf(stderr, "%s is not a trace\n", argv[optind]);
+    return 1;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  // (the pheromone records must fit the int32 sizes)
+  hdr = (const trace_header_t *)data;
+  if (memcmp(hdr->magic, TRACE_MAGIC, 8) || hdr->nodes <= 0 ||
+      sizeof(double) * (uint64_t)hdr->nodes * hdr->nodes > INT32_MAX) {
+    fprintf(stderr, "%s is not a trace\n", argv[optind]);
+    return 1;
+  }
+  printf("# nodes %d ants %d\n", hdr->nodes, hdr->ants);
+
+  for (off=sizeof(trace_header_t); off + sizeof(trace_record_t) <= st.st_size;
+       off+=rec->size) {
+    rec = (const trace_record_t *)(data + off);
+    // an interrupted run could leave a partial record
+    if (rec->size <= 0 || rec->size % 8 || off + rec->size > st.st_size) {
+      fprintf(stderr, "Truncated record at offset %lu\n", (unsigned long)off);
+      break;
+    }
+    if (rec->size != record_size(rec, hdr->nodes)) {
+      fprintf(stderr, "Corrupt record at offset %lu\n", (unsigned long)off);
+      break;
+    }
+    if (rec->type == TRACE_ANT)
+      dump_ant((const char *)(rec + 1), hdr->nodes);
+    else if (rec->type == TRACE_PHERO && !ants_only)
+      dump_phero((const char *)(rec + 1), hdr->nodes);
+  }
+
+  munmap(data, st.st_size);
+  return 0;
+
+}
@@ -0,0 +1,64 @@
+#import  <Foundation/Foundation.h>
+#import "GSL.h"
+#import "Graph.h"
+
+
+/*
+  Worker processes for graph evaluation
+
+  The ACO (coordinator) generates the graphs of a step and sends them
+  to worker processes that hold their own copy of the training data
+  and evaluate them (see evaluate_graph()). The workers are either
+  forked locally (connected through socket pairs) or remote netinf
+  processes that serve evaluations on a TCP port (see --serve).
+
+  Messages (in the byte order of the hosts, which must agree) :
+
+  ** hello (worker -> coordinator, once) : int32 nodes
+  ** request (coordinator -> worker) : uint64 seed, int32 nodes,
+     int32 edges, followed by (from, to) int32 pairs (one per edge)
+  ** response (worker -> coordinator) : nodes doubles (the errors)
+
+  The workers close the connection on a malformed request (wrong number
+  of nodes or edges, or an unknown node).
+
+  The seed initializes the RNG of the evaluation, and each worker
+  evaluates its graphs in the order they were assigned to it, so the
+  results depend only on the seeds and the number of workers.
+ */
+
+
+// fork n local worker processes
+// returns 0 on success
+int workers_spawn(int n);
+
+// connect to the remote workers in addrs ("host:port,host:port,...")
+// returns 0 on success
+int workers_connect(const char *addrs);
+
+// serve graph evaluations on a TCP port of the local address host
+// (one coordinator at a time; there is no authentication, so host
+// should be reachable only by trusted coordinators)
+// returns only on error
+int workers_serve(const char *host, int port);
+
+// the number of available workers (0 : evaluate locally)
+int workers_count(void);
+
+// evaluate count graphs on the workers (graph i with RNG seed seeds[i])
+// errors[i] receives the per-target errors of graph i (autoreleased)
+// returns 0 on success
+int workers_evaluate(Digraph **graphs, unsigned long *seeds,
+		     GSLVector **errors, int count);
+
+// send graph g (with RNG seed) to the idle worker w
+// returns 0 on success
+int workers_submit(int w, Digraph *g, unsigned long seed);
+
+// wait for any worker that has a graph to respond
+// errors receives the per-target errors (autoreleased)
+// returns the worker (which is idle again) or -1 on error
+int workers_receive(GSLVector **errors);
+
+// stop the workers and close the connections
+void workers_close(void);
@@ -0,0 +1,438 @@
+#import "workers.h"
+#import "graphs.h"
+#import "params.h"
+
+#import <stdint.h>
+#import <string.h>
+#import <errno.h>
+#import <unistd.h>
+#import <poll.h>
+#import <netdb.h>
+#import <signal.h>
+#import <sys/types.h>
+#import <sys/socket.h>
+#import <sys/wait.h>
+#import <netinet/in.h>
+
+
+// max number of workers
+#define MAX_WORKERS 256
+
+
+// the connections to the workers
+static int fds[MAX_WORKERS];
+static pid_t pids[MAX_WORKERS]; // 0 for remote workers
+static BOOL busy[MAX_WORKERS]; // whether a worker has a graph
+static int nworkers = 0;
+
+
+
+//=================================================================
+//          LOW-LEVEL I/O
+//=================================================================
+
+// read/write exactly len bytes (0 on success)
+static int read_all(int fd, void *buf, size_t len) {
+
+  char *p = buf;
+  ssize_t n;
+
+  while (len > 0) {
+    n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+
+}
+
+
+static int write_all(int fd, const void *buf, size_t len) {
+
+  const char *p = buf;
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+
+}
+
+
+
+//=================================================================
+//          WORKER SIDE
+//=================================================================
+
+// serve the requests of a coordinator until it closes the connection
+static void serve_fd(int fd) {
+
+  uint64_t seed;
+  int32_t hdr[2], nodes = settings.nodes;
+  int32_t *pairs;
+  double err[settings.nodes];
+  int i;
+  Digraph *g;
+  GSLVector *v;
+  RNG *rng;
+  NSAutoreleasePool *pool;
+
+  // hello
+  if (write_all(fd, &nodes, sizeof(nodes)))
+    return;
+
+  while (read_all(fd, &seed, sizeof(seed)) == 0 &&
+	 read_all(fd, hdr, sizeof(hdr)) == 0) {
+    // a malformed request closes the connection
+    if (hdr[0] != nodes || hdr[1] < 0 || hdr[1] > nodes * nodes) {
+      fprintf(stderr, "Bad request (%d nodes, %d edges)\n", hdr[0], hdr[1]);
+      return;
+    }
+    pool = [[NSAutoreleasePool alloc] init];
+    // read the graph
+    pairs = malloc(sizeof(int32_t) * (2 * hdr[1] + 1));
+    if (read_all(fd, pairs, sizeof(int32_t) * 2 * hdr[1])) {
+      free(pairs);
+      [pool release];
+      return;
+    }
+    for (i=0; i<2*hdr[1]; i++)
+      if (pairs[i] < 0 || pairs[i] >= nodes) {
+	fprintf(stderr, "Bad request (node %d)\n", pairs[i]);
+	free(pairs);
+	[pool release];
+	return;
+      }
+    g = [Digraph digraphWithNodes:hdr[0]];
+    for (i=0; i<hdr[1]; i++)
+      [g addEdgeFrom:[NSNumber numberWithInt:pairs[2*i]]
+		  To:[NSNumber numberWithInt:pairs[2*i+1]]];
+    free(pairs);
+    // evaluate it with the RNG stream of the request
+    rng = [[RNG alloc] initWithSeed:(unsigned long)seed];
+    set_thread_rng(rng);
+    v = evaluate_graph(g, NULL);
+    set_thread_rng(nil);
+    [rng release];
+    // respond
+    for (i=0; i<nodes; i++)
+      err[i] = [v valueAtIndex:i];
+    [pool release];
+    if (write_all(fd, err, sizeof(double) * nodes))
+      return;
+  }
+
+}
+
+
+
+int workers_serve(const char *host, int port) {
+
+  int sock, fd, on = 1;
+  struct addrinfo hints, *res;
+  char service[16];
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &res)) {
+    fprintf(stderr, "Unknown listen address %s\n", host);
+    return -1;
+  }
+
+  sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (sock < 0) {
+    perror("socket");
+    freeaddrinfo(res);
+    return -1;
+  }
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (bind(sock, res->ai_addr, res->ai_addrlen) ||
+      listen(sock, 1)) {
+    perror("bind/listen");
+    freeaddrinfo(res);
+    close(sock);
+    return -1;
+  }
+  freeaddrinfo(res);
+
+  printf("Serving graph evaluations on %s:%d\n", host, port);
+  fflush(stdout);
+
+  // one coordinator at a time
+  while ((fd = accept(sock, NULL, NULL)) >= 0) {
+    printf("Coordinator connected\n");
+    fflush(stdout);
+    serve_fd(fd);
+    close(fd);
+    printf("Coordinator disconnected\n");
+    fflush(stdout);
+  }
+
+  perror("accept");
+  close(sock);
+  return -1;
+
+}
+
+
+
+//=================================================================
+//          COORDINATOR SIDE
+//=================================================================
+
+// check the hello message of a new worker and add it
+static int add_worker(int fd, pid_t pid) {
+
+  int32_t nodes;
+
+  if (read_all(fd, &nodes, sizeof(nodes)) || nodes != settings.nodes) {
+    fprintf(stderr, "Worker mismatch (expected %d nodes)\n", settings.nodes);
+    close(fd);
+    return -1;
+  }
+
+  fds[nworkers] = fd;
+  pids[nworkers] = pid;
+  busy[nworkers] = NO;
+  nworkers += 1;
+
+  return 0;
+
+}
+
+
+
+int workers_spawn(int n) {
+
+  int i, sv[2];
+  pid_t pid;
+
+  // a worker that dies must not kill the coordinator
+  signal(SIGPIPE, SIG_IGN);
+
+  for (i=0; i<n && nworkers<MAX_WORKERS; i++) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+      perror("socketpair");
+      return -1;
+    }
+    // make sure that nothing is written twice
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return -1;
+    }
+    if (pid == 0) {
+      // WORKER :: close the coordinator's ends and serve
+      close(sv[0]);
+      for (i=0; i<nworkers; i++)
+	close(fds[i]);
+      serve_fd(sv[1]);
+      _exit(0);
+    }
+    // COORDINATOR
+    close(sv[1]);
+    if (add_worker(sv[0], pid))
+      return -1;
+  }
+
+  return 0;
+
+}
+
+
+
+int workers_connect(const char *addrs) {
+
+  char *list = strdup(addrs), *item, *port, *save;
+  struct addrinfo hints, *res;
+  int fd;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  for (item=strtok_r(list, ",", &save); item; item=strtok_r(NULL, ",", &save)) {
+    port = strrchr(item, ':');
+    if (!port || nworkers >= MAX_WORKERS) {
+      fprintf(stderr, "Bad worker address %s\n", item);
+      free(list);
+      return -1;
+    }
+    *port++ = '\0';
+    if (getaddrinfo(item, port, &hints, &res)) {
+      fprintf(stderr, "Unknown worker host %s\n", item);
+      free(list);
+      return -1;
+    }
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen)) {
+      fprintf(stderr, "Can not connect to worker %s:%s\n", item, port);
+      freeaddrinfo(res);
+      free(list);
+      return -1;
+    }
+    freeaddrinfo(res);
+    if (add_worker(fd, 0)) {
+      free(list);
+      return -1;
+    }
+    printf("Connected to worker %s:%s\n", item, port);
+  }
+
+  free(list);
+  return 0;
+
+}
+
+
+
+int workers_count(void) {
+
+  return nworkers;
+
+}
+
+
+
+int workers_submit(int w, Digraph *g, unsigned long seed) {
+
+  const cgraph_t *c = [g compact];
+  int i, n = c->edges, res;
+  uint64_t s = seed;
+  int32_t hdr[2] = {c->nodes, n};
+  int32_t *pairs = malloc(sizeof(int32_t) * (2 * n + 1));
+
+  for (i=0; i<n; i++) {
+    pairs[2*i] = c->in[i];
+    pairs[2*i+1] = c->trg[i];
+  }
+
+  res = write_all(fds[w], &s, sizeof(s)) ||
+    write_all(fds[w], hdr, sizeof(hdr)) ||
+    write_all(fds[w], pairs, sizeof(int32_t) * 2 * n);
+  free(pairs);
+
+  if (! res)
+    busy[w] = YES;
+
+  return res;
+
+}
+
+
+
+int workers_receive(GSLVector **errors) {
+
+  int w, i, n = 0, map[nworkers];
+  struct pollfd pfd[nworkers];
+  double err[settings.nodes];
+
+  // poll the busy workers
+  for (w=0; w<nworkers; w++)
+    if (busy[w]) {
+      pfd[n].fd = fds[w];
+      pfd[n].events = POLLIN;
+      map[n] = w;
+      n += 1;
+    }
+  if (n == 0)
+    return -1;
+
+  while (poll(pfd, n, -1) < 0)
+    if (errno != EINTR)
+      return -1;
+
+  // the first worker that responded
+  for (i=0; i<n && !pfd[i].revents; i++)
+    ;
+  w = map[i];
+
+  if (read_all(fds[w], err, sizeof(double) * settings.nodes)) {
+    fprintf(stderr, "Worker %d failed\n", w);
+    return -1;
+  }
+  busy[w] = NO;
+
+  *errors = [GSLVector vectorWithSize:settings.nodes];
+  for (i=0; i<settings.nodes; i++)
+    [*errors setValue:err[i]
+	      atIndex:i];
+
+  return w;
+
+}
+
+
+
+int workers_evaluate(Digraph **graphs, unsigned long *seeds,
+		     GSLVector **errors, int count) {
+
+  int w, next[nworkers], npending = 0;
+  GSLVector *v;
+
+  // worker w evaluates graphs w, w+nworkers, ... (in this order)
+  // and has at most one graph at a time
+  for (w=0; w<nworkers; w++) {
+    next[w] = w;
+    if (next[w] < count) {
+      if (workers_submit(w, graphs[next[w]], seeds[next[w]]))
+	return -1;
+      npending += 1;
+    }
+  }
+
+  while (npending > 0) {
+    // receive the errors of the current graph of a worker
+    w = workers_receive(&v);
+    if (w < 0)
+      return -1;
+    errors[next[w]] = v;
+    npending -= 1;
+    // send the next graph of w
+    next[w] += nworkers;
+    if (next[w] < count) {
+      if (workers_submit(w, graphs[next[w]], seeds[next[w]]))
+	return -1;
+      npending += 1;
+    }
+  }
+
+  return 0;
+
+}
+
+
+
+void workers_close(void) {
+
+  int w;
+
+  // closing the connections stops the workers
+  for (w=0; w<nworkers; w++) {
+    close(fds[w]);
+    if (pids[w] > 0)
+      waitpid(pids[w], NULL, 0);
+  }
+  nworkers = 0;
+
+}